@@ -0,0 +1,854 @@
+#include "assembler.hpp"
+#include "csr.hpp"
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+
+enum asm_format : uint8_t
+{
+    FMT_R,
+    FMT_I,
+    FMT_SHIFT,
+    FMT_LOAD,
+    FMT_STORE,
+    FMT_BRANCH,
+    FMT_JAL,
+    FMT_JALR,
+    FMT_SYSTEM,  // ecall and ebreak (funct7 1)
+    FMT_CSR,     // csrrw/csrrs/csrrc and the immediate forms
+    PSEUDO_NOP,
+    PSEUDO_LI, // li and la
+    PSEUDO_MV,
+    PSEUDO_NOT,
+    PSEUDO_NEG,
+    PSEUDO_SEQZ,
+    PSEUDO_SNEZ,
+    PSEUDO_J,
+    PSEUDO_JR,
+    PSEUDO_RET,
+    PSEUDO_CALL,
+    PSEUDO_BRANCH_ZERO, // beqz and bnez
+    PSEUDO_CSR_READ,    // csrr
+    PSEUDO_CSR_WRITE,   // csrw, csrs, csrc and the immediate forms
+    PSEUDO_RD_COUNTER   // rdcycle, rdtime, rdinstret; funct7 is the low byte of the CSR number
+};
+
+struct asm_opcode
+{
+    asm_format format;
+    uint8_t funct3;
+    uint8_t funct7;
+};
+
+static const unordered_map<string, asm_opcode> opcodes = {
+    {"add", {FMT_R, 0, 0x00}}, {"sub", {FMT_R, 0, 0x20}}, {"sll", {FMT_R, 1, 0}}, {"slt", {FMT_R, 2, 0}},
+    {"sltu", {FMT_R, 3, 0}}, {"xor", {FMT_R, 4, 0}}, {"srl", {FMT_R, 5, 0}}, {"sra", {FMT_R, 5, 0x20}},
+    {"or", {FMT_R, 6, 0}}, {"and", {FMT_R, 7, 0}},
+    {"addi", {FMT_I, 0, 0}}, {"slti", {FMT_I, 2, 0}}, {"sltiu", {FMT_I, 3, 0}}, {"xori", {FMT_I, 4, 0}},
+    {"ori", {FMT_I, 6, 0}}, {"andi", {FMT_I, 7, 0}},
+    {"slli", {FMT_SHIFT, 1, 0}}, {"srli", {FMT_SHIFT, 5, 0}}, {"srai", {FMT_SHIFT, 5, 0x20}},
+    {"lb", {FMT_LOAD, 0, 0}}, {"lh", {FMT_LOAD, 1, 0}}, {"lw", {FMT_LOAD, 2, 0}}, {"ld", {FMT_LOAD, 3, 0}},
+    {"lbu", {FMT_LOAD, 4, 0}}, {"lhu", {FMT_LOAD, 5, 0}}, {"lwu", {FMT_LOAD, 6, 0}},
+    {"sb", {FMT_STORE, 0, 0}}, {"sh", {FMT_STORE, 1, 0}}, {"sw", {FMT_STORE, 2, 0}}, {"sd", {FMT_STORE, 3, 0}},
+    {"beq", {FMT_BRANCH, 0, 0}}, {"bne", {FMT_BRANCH, 1, 0}},
+    {"jal", {FMT_JAL, 0, 0}}, {"jalr", {FMT_JALR, 0, 0}},
+    {"nop", {PSEUDO_NOP, 0, 0}}, {"li", {PSEUDO_LI, 0, 0}}, {"la", {PSEUDO_LI, 0, 0}},
+    {"mv", {PSEUDO_MV, 0, 0}}, {"not", {PSEUDO_NOT, 0, 0}}, {"neg", {PSEUDO_NEG, 0, 0}},
+    {"seqz", {PSEUDO_SEQZ, 0, 0}}, {"snez", {PSEUDO_SNEZ, 0, 0}},
+    {"j", {PSEUDO_J, 0, 0}}, {"jr", {PSEUDO_JR, 0, 0}}, {"ret", {PSEUDO_RET, 0, 0}},
+    {"call", {PSEUDO_CALL, 0, 0}}, {"beqz", {PSEUDO_BRANCH_ZERO, 0, 0}}, {"bnez", {PSEUDO_BRANCH_ZERO, 1, 0}},
+    {"ecall", {FMT_SYSTEM, 0, 0}}, {"ebreak", {FMT_SYSTEM, 0, 1}},
+    {"csrrw", {FMT_CSR, 1, 0}}, {"csrrs", {FMT_CSR, 2, 0}}, {"csrrc", {FMT_CSR, 3, 0}},
+    {"csrrwi", {FMT_CSR, 5, 0}}, {"csrrsi", {FMT_CSR, 6, 0}}, {"csrrci", {FMT_CSR, 7, 0}},
+    {"csrr", {PSEUDO_CSR_READ, 2, 0}},
+    {"csrw", {PSEUDO_CSR_WRITE, 1, 0}}, {"csrs", {PSEUDO_CSR_WRITE, 2, 0}}, {"csrc", {PSEUDO_CSR_WRITE, 3, 0}},
+    {"csrwi", {PSEUDO_CSR_WRITE, 5, 0}}, {"csrsi", {PSEUDO_CSR_WRITE, 6, 0}}, {"csrci", {PSEUDO_CSR_WRITE, 7, 0}},
+    {"rdcycle", {PSEUDO_RD_COUNTER, 2, CSR_CYCLE & 0xFF}}, {"rdtime", {PSEUDO_RD_COUNTER, 2, CSR_TIME & 0xFF}},
+    {"rdinstret", {PSEUDO_RD_COUNTER, 2, CSR_INSTRET & 0xFF}}};
+
+// CSR operands may be written by name
+static const struct
+{
+    const char *name;
+    uint32_t number;
+} csr_names[] = {{"cycle", CSR_CYCLE}, {"time", CSR_TIME}, {"instret", CSR_INSTRET}, {"roi", CSR_ROI}};
+
+static const char *const abi_names[32] = {
+    "zero", "ra", "sp", "gp", "tp", "t0", "t1", "t2", "s0", "s1", "a0", "a1", "a2", "a3", "a4", "a5",
+    "a6", "a7", "s2", "s3", "s4", "s5", "s6", "s7", "s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6"};
+
+struct asm_operand
+{
+    enum kind_t : uint8_t
+    {
+        Register,
+        Number,
+        Symbol
+    } kind = Number;
+    uint8_t reg = 0;
+    uint32_t symbol = 0;
+    int64_t value = 0; // the number, or the offset added to the symbol
+};
+
+enum asm_statement_kind : uint8_t
+{
+    STMT_INSTRUCTION,
+    STMT_LABEL,
+    STMT_WORD, // raw instruction word from .word in .text
+    STMT_ALIGN
+};
+
+struct asm_statement
+{
+    asm_statement_kind kind = STMT_INSTRUCTION;
+    asm_format format = PSEUDO_NOP;
+    uint8_t funct3 = 0;
+    uint8_t funct7 = 0;
+    uint8_t count = 0;
+    uint32_t line = 0;
+    asm_operand operands[3];
+};
+
+struct asm_symbol
+{
+    string name;
+    int64_t value = 0;
+    bool defined = false;
+};
+
+// Data item whose value is a label, filled in once the code is laid out
+struct data_fixup
+{
+    uint64_t address;
+    unsigned width;
+    asm_operand value;
+    uint32_t line;
+};
+
+struct asm_token
+{
+    const char *text;
+    size_t length;
+
+    string str() const { return string(text, length); }
+    bool is(const char *s) const { return length == strlen(s) && memcmp(text, s, length) == 0; }
+};
+
+static int64_t sign_extend(uint64_t value, unsigned width)
+{
+    if (width >= 8)
+        return (int64_t)value;
+    unsigned shift = 64 - width * 8;
+    return (int64_t)(value << shift) >> shift;
+}
+
+static bool fits_signed(int64_t value, unsigned bits)
+{
+    return value >= -(int64_t(1) << (bits - 1)) && value < (int64_t(1) << (bits - 1));
+}
+
+static uint32_t r_type(uint8_t funct7, uint8_t rs2, uint8_t rs1, uint8_t funct3, uint8_t rd)
+{
+    return (uint32_t)funct7 << 25 | (uint32_t)rs2 << 20 | (uint32_t)rs1 << 15 | (uint32_t)funct3 << 12 | (uint32_t)rd << 7 | 0x33;
+}
+
+static uint32_t i_type(int64_t imm, uint8_t rs1, uint8_t funct3, uint8_t rd, uint32_t opcode)
+{
+    return (uint32_t)(imm & 0xFFF) << 20 | (uint32_t)rs1 << 15 | (uint32_t)funct3 << 12 | (uint32_t)rd << 7 | opcode;
+}
+
+static uint32_t s_type(int64_t imm, uint8_t rs2, uint8_t rs1, uint8_t funct3)
+{
+    return (uint32_t)((imm >> 5) & 0x7F) << 25 | (uint32_t)rs2 << 20 | (uint32_t)rs1 << 15 | (uint32_t)funct3 << 12 |
+           (uint32_t)(imm & 0x1F) << 7 | 0x23;
+}
+
+static uint32_t b_type(int64_t imm, uint8_t rs2, uint8_t rs1, uint8_t funct3)
+{
+    return (uint32_t)((imm >> 12) & 1) << 31 | (uint32_t)((imm >> 5) & 0x3F) << 25 | (uint32_t)rs2 << 20 |
+           (uint32_t)rs1 << 15 | (uint32_t)funct3 << 12 | (uint32_t)((imm >> 1) & 0xF) << 8 |
+           (uint32_t)((imm >> 11) & 1) << 7 | 0x63;
+}
+
+static uint32_t j_type(int64_t imm, uint8_t rd)
+{
+    return (uint32_t)((imm >> 20) & 1) << 31 | (uint32_t)((imm >> 1) & 0x3FF) << 21 | (uint32_t)((imm >> 11) & 1) << 20 |
+           (uint32_t)((imm >> 12) & 0xFF) << 12 | (uint32_t)rd << 7 | 0x6F;
+}
+
+// li without lui: the upper part recursively, shifted into place, plus the low 12 bits
+static void materialize(int64_t value, uint8_t rd, vector<uint32_t> &words)
+{
+    if (fits_signed(value, 12))
+    {
+        words.push_back(i_type(value, 0, 0, rd, 0x13));
+        return;
+    }
+    int64_t low = (int64_t)((uint64_t)value << 52) >> 52;
+    int64_t high = (int64_t)((uint64_t)value - (uint64_t)low) >> 12;
+    unsigned zeros = __builtin_ctzll(high);
+    materialize(high >> zeros, rd, words);
+    words.push_back(i_type(12 + zeros, rd, 1, rd, 0x13));
+    if (low)
+        words.push_back(i_type(low, rd, 0, rd, 0x13));
+}
+
+static bool parse_register(const asm_token &token, uint8_t &reg)
+{
+    if (token.length >= 2 && token.length <= 3 && token.text[0] == 'x')
+    {
+        unsigned n = 0;
+        for (size_t i = 1; i < token.length; i++)
+        {
+            if (token.text[i] < '0' || token.text[i] > '9')
+                return false;
+            n = n * 10 + (token.text[i] - '0');
+        }
+        if (n >= 32 || (token.length == 3 && token.text[1] == '0'))
+            return false;
+        reg = n;
+        return true;
+    }
+    if (token.is("fp"))
+    {
+        reg = 8;
+        return true;
+    }
+    for (unsigned i = 0; i < 32; i++)
+    {
+        if (token.is(abi_names[i]))
+        {
+            reg = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool parse_number(const char *text, size_t length, int64_t &value)
+{
+    bool negative = false;
+    if (length && (text[0] == '-' || text[0] == '+'))
+    {
+        negative = text[0] == '-';
+        text++;
+        length--;
+    }
+    char digits[32];
+    if (length == 0 || length >= sizeof(digits) || text[0] < '0' || text[0] > '9')
+        return false;
+    // Decimal unless prefixed 0x or 0b; a leading zero does not mean octal
+    int base = 10;
+    if (length > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X' || text[1] == 'b' || text[1] == 'B'))
+    {
+        base = (text[1] == 'b' || text[1] == 'B') ? 2 : 16;
+        text += 2;
+        length -= 2;
+    }
+    memcpy(digits, text, length);
+    digits[length] = 0;
+    char *end;
+    errno = 0;
+    uint64_t magnitude = strtoull(digits, &end, base);
+    if (errno || end != digits + length || !isalnum((unsigned char)digits[0]))
+        return false;
+    value = negative ? (int64_t)(0 - magnitude) : (int64_t)magnitude;
+    return true;
+}
+
+static bool is_identifier(const asm_token &token)
+{
+    if (token.length == 0 || !(isalpha((unsigned char)token.text[0]) || token.text[0] == '_' || token.text[0] == '.'))
+        return false;
+    for (size_t i = 1; i < token.length; i++)
+    {
+        char c = token.text[i];
+        if (!(isalnum((unsigned char)c) || c == '_' || c == '.' || c == '$'))
+            return false;
+    }
+    return true;
+}
+
+class source_assembler
+{
+    const string &source;
+    uint32_t line = 0;
+    bool in_data = false;
+    uint64_t data_address = 0;
+
+    vector<asm_statement> statements;
+    vector<asm_symbol> symbols;
+    unordered_map<string, uint32_t> symbol_ids;
+    vector<data_fixup> fixups;
+    vector<asm_token> tokens; // current line, reused
+    vector<uint32_t> words;   // encoding of the current statement, reused
+
+    assembled_program out;
+
+    [[noreturn]] void fail(uint32_t at, const string &message) const
+    {
+        throw runtime_error("line " + to_string(at) + ": " + message);
+    }
+
+    uint32_t intern(const string &name)
+    {
+        auto found = symbol_ids.find(name);
+        if (found != symbol_ids.end())
+            return found->second;
+        uint32_t id = symbols.size();
+        symbol_ids.emplace(name, id);
+        symbols.push_back({name, 0, false});
+        return id;
+    }
+
+    void define(uint32_t id, int64_t value, uint32_t at)
+    {
+        if (symbols[id].defined)
+            fail(at, "'" + symbols[id].name + "' is already defined");
+        symbols[id].value = value;
+        symbols[id].defined = true;
+    }
+
+    asm_operand parse_operand(const asm_token &token)
+    {
+        asm_operand operand;
+        if (parse_register(token, operand.reg))
+        {
+            operand.kind = asm_operand::Register;
+            return operand;
+        }
+        if (parse_number(token.text, token.length, operand.value))
+            return operand;
+
+        // symbol, symbol+offset or symbol-offset
+        size_t split = 1;
+        while (split < token.length && token.text[split] != '+' && token.text[split] != '-')
+            split++;
+        asm_token name = {token.text, split};
+        if (!is_identifier(name) ||
+            (split < token.length && !parse_number(token.text + split, token.length - split, operand.value)))
+            fail(line, "cannot parse operand '" + token.str() + "'");
+        operand.kind = asm_operand::Symbol;
+        operand.symbol = intern(name.str());
+        return operand;
+    }
+
+    // Value of an operand that has to be known already (.equ, .org, li)
+    int64_t known_value(const asm_operand &operand, uint32_t at) const
+    {
+        if (operand.kind == asm_operand::Register)
+            fail(at, "expected a number, not a register");
+        if (operand.kind == asm_operand::Number)
+            return operand.value;
+        const asm_symbol &symbol = symbols[operand.symbol];
+        if (!symbol.defined)
+            fail(at, "'" + symbol.name + "' must be defined before it is used here");
+        return symbol.value + operand.value;
+    }
+
+    int64_t value(const asm_operand &operand, uint32_t at) const
+    {
+        if (operand.kind == asm_operand::Symbol && !symbols[operand.symbol].defined)
+            fail(at, "undefined symbol '" + symbols[operand.symbol].name + "'");
+        return known_value(operand, at);
+    }
+
+    uint8_t reg(const asm_operand &operand, uint32_t at) const
+    {
+        if (operand.kind != asm_operand::Register)
+            fail(at, "expected a register");
+        return operand.reg;
+    }
+
+    // Branch and jump targets: labels are absolute, numbers are byte offsets as in the listings
+    int64_t offset(const asm_operand &operand, uint64_t pc, unsigned bits, uint32_t at) const
+    {
+        int64_t distance = value(operand, at) - (operand.kind == asm_operand::Symbol ? (int64_t)pc : 0);
+        if ((distance & 1) || !fits_signed(distance, bits))
+            fail(at, "jump target out of range");
+        return distance;
+    }
+
+    // A CSR name, unless a symbol of that name was defined, or a number
+    uint32_t csr(const asm_operand &operand, uint32_t at) const
+    {
+        if (operand.kind == asm_operand::Symbol && !symbols[operand.symbol].defined)
+        {
+            for (const auto &named : csr_names)
+                if (symbols[operand.symbol].name == named.name && operand.value == 0)
+                    return named.number;
+        }
+        int64_t number = value(operand, at);
+        if (number < 0 || number > 0xFFF)
+            fail(at, "CSR number out of range");
+        return number;
+    }
+
+    // rs1 of a CSR instruction, or the 5-bit immediate of the csrr*i forms
+    uint8_t csr_source(const asm_operand &operand, uint8_t funct3, uint32_t at) const
+    {
+        if (!(funct3 & 0x4))
+            return reg(operand, at);
+        int64_t zimm = value(operand, at);
+        if (zimm < 0 || zimm > 31)
+            fail(at, "CSR immediate out of range");
+        return zimm;
+    }
+
+    int64_t immediate(const asm_operand &operand, uint32_t at) const
+    {
+        int64_t imm = value(operand, at);
+        if (!fits_signed(imm, 12))
+            fail(at, "immediate " + to_string(imm) + " does not fit in 12 bits");
+        return imm;
+    }
+
+    void split_line(const char *begin, const char *end)
+    {
+        tokens.clear();
+        const char *p = begin;
+        while (p < end)
+        {
+            char c = *p;
+            if (c == ' ' || c == '\t' || c == '\r' || c == ',' || c == '(' || c == ')')
+            {
+                p++;
+                continue;
+            }
+            const char *start = p;
+            while (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != ',' && *p != '(' && *p != ')')
+            {
+                // A label ends its token even when the instruction follows without a space
+                if (*p++ == ':')
+                    break;
+            }
+            tokens.push_back({start, (size_t)(p - start)});
+        }
+    }
+
+    void data_item(const asm_token &token, unsigned width)
+    {
+        asm_operand item = parse_operand(token);
+        if (item.kind == asm_operand::Register)
+            fail(line, "expected a value, not a register");
+        if (item.kind == asm_operand::Number)
+            out.data[data_address] = sign_extend(item.value, width);
+        else
+            fixups.push_back({data_address, width, item, line});
+        data_address += width;
+    }
+
+    void directive(size_t first)
+    {
+        const asm_token &name = tokens[first];
+        size_t args = tokens.size() - first - 1;
+        const asm_token *arg = tokens.data() + first + 1;
+
+        if (name.is(".text"))
+            in_data = false;
+        else if (name.is(".data") || name.is(".bss") || name.is(".rodata"))
+            in_data = true;
+        else if (name.is(".section"))
+            in_data = !(args && arg[0].length >= 5 && memcmp(arg[0].text, ".text", 5) == 0);
+        else if (name.is(".globl") || name.is(".global") || name.is(".type") || name.is(".size") ||
+                 name.is(".file") || name.is(".option") || name.is(".ident"))
+            return;
+        else if (name.is(".equ") || name.is(".set"))
+        {
+            if (args != 2 || !is_identifier(arg[0]))
+                fail(line, name.str() + " takes a name and a value");
+            define(intern(arg[0].str()), known_value(parse_operand(arg[1]), line), line);
+        }
+        else if (name.is(".word") || name.is(".dword") || name.is(".half") || name.is(".byte"))
+        {
+            unsigned width = name.is(".word") ? 4 : name.is(".dword") ? 8 : name.is(".half") ? 2 : 1;
+            if (!in_data)
+            {
+                // Raw instruction words
+                if (width != 4)
+                    fail(line, name.str() + " is only allowed in .data");
+                for (size_t i = 0; i < args; i++)
+                {
+                    asm_statement word;
+                    word.kind = STMT_WORD;
+                    word.line = line;
+                    word.operands[0].value = known_value(parse_operand(arg[i]), line);
+                    statements.push_back(word);
+                }
+                return;
+            }
+            for (size_t i = 0; i < args; i++)
+                data_item(arg[i], width);
+        }
+        else if (name.is(".space") || name.is(".zero") || name.is(".org"))
+        {
+            if (!in_data)
+                fail(line, name.str() + " is only allowed in .data");
+            if (args != 1)
+                fail(line, name.str() + " takes one value");
+            int64_t amount = known_value(parse_operand(arg[0]), line);
+            data_address = name.is(".org") ? amount : data_address + amount;
+        }
+        else if (name.is(".align") || name.is(".p2align"))
+        {
+            if (args < 1)
+                fail(line, name.str() + " takes a power of two");
+            int64_t power = known_value(parse_operand(arg[0]), line);
+            if (power < 0 || power > 16)
+                fail(line, "alignment out of range");
+            uint64_t step = uint64_t(1) << power;
+            if (in_data)
+            {
+                data_address = (data_address + step - 1) & ~(step - 1);
+                return;
+            }
+            asm_statement align;
+            align.kind = STMT_ALIGN;
+            align.line = line;
+            align.operands[0].value = step;
+            statements.push_back(align);
+        }
+        else
+            fail(line, "unknown directive " + name.str());
+    }
+
+    void instruction(size_t first)
+    {
+        const asm_token &mnemonic = tokens[first];
+        if (in_data)
+            fail(line, "instruction in .data");
+        auto found = opcodes.find(mnemonic.str());
+        if (found == opcodes.end())
+            fail(line, "unknown instruction '" + mnemonic.str() + "'");
+        if (tokens.size() - first - 1 > 3)
+            fail(line, "too many operands");
+
+        asm_statement statement;
+        statement.format = found->second.format;
+        statement.funct3 = found->second.funct3;
+        statement.funct7 = found->second.funct7;
+        statement.line = line;
+        for (size_t i = first + 1; i < tokens.size(); i++)
+            statement.operands[statement.count++] = parse_operand(tokens[i]);
+        statements.push_back(statement);
+    }
+
+    // Pass 1: tokenize, lay out the data section, collect code statements
+    void parse()
+    {
+        const char *p = source.data();
+        const char *end = p + source.size();
+        statements.reserve(source.size() / 16);
+        while (p < end)
+        {
+            const char *eol = static_cast<const char *>(memchr(p, '\n', end - p));
+            if (!eol)
+                eol = end;
+            line++;
+
+            const char *stop = p;
+            while (stop < eol && *stop != '#' && !(*stop == '/' && stop + 1 < eol && stop[1] == '/'))
+                stop++;
+            split_line(p, stop);
+            p = eol + 1;
+
+            size_t first = 0;
+            while (first < tokens.size() && tokens[first].text[tokens[first].length - 1] == ':')
+            {
+                asm_token label = {tokens[first].text, tokens[first].length - 1};
+                if (!is_identifier(label))
+                    fail(line, "bad label '" + label.str() + "'");
+                uint32_t id = intern(label.str());
+                if (in_data)
+                {
+                    define(id, data_address, line);
+                }
+                else
+                {
+                    asm_statement mark;
+                    mark.kind = STMT_LABEL;
+                    mark.line = line;
+                    mark.operands[0].symbol = id;
+                    statements.push_back(mark);
+                }
+                first++;
+            }
+            if (first == tokens.size())
+                continue;
+
+            if (tokens[first].text[0] == '.')
+                directive(first);
+            else
+                instruction(first);
+        }
+    }
+
+    size_t nops_to_align(uint64_t pc, uint64_t step) const
+    {
+        return step <= 4 ? 0 : (((pc + step - 1) & ~(step - 1)) - pc) / 4;
+    }
+
+    // Pass 2 (first half): code label addresses; li is sized from its now known value
+    void layout()
+    {
+        uint64_t pc = 0;
+        for (asm_statement &statement : statements)
+        {
+            switch (statement.kind)
+            {
+            case STMT_LABEL:
+                define(statement.operands[0].symbol, pc, statement.line);
+                break;
+            case STMT_ALIGN:
+                pc += 4 * nops_to_align(pc, statement.operands[0].value);
+                break;
+            case STMT_WORD:
+                pc += 4;
+                break;
+            case STMT_INSTRUCTION:
+                if (statement.format == PSEUDO_LI)
+                {
+                    if (statement.count != 2)
+                        fail(statement.line, "li and la take a register and a value");
+                    asm_operand &constant = statement.operands[1];
+                    constant.value = known_value(constant, statement.line);
+                    constant.kind = asm_operand::Number;
+                    words.clear();
+                    materialize(constant.value, 0, words);
+                    pc += 4 * words.size();
+                }
+                else
+                    pc += 4;
+                break;
+            }
+        }
+    }
+
+    void expect(const asm_statement &statement, uint8_t count) const
+    {
+        if (statement.count != count)
+            fail(statement.line, "expected " + to_string(count) + " operands");
+    }
+
+    // imm(rs1), "imm rs1", (rs1) or an absolute address, from operand index first on
+    void memory_operand(const asm_statement &statement, size_t first, int64_t &imm, uint8_t &base) const
+    {
+        const asm_operand *o = statement.operands;
+        if (statement.count == first + 1)
+        {
+            bool is_base = o[first].kind == asm_operand::Register;
+            imm = is_base ? 0 : immediate(o[first], statement.line);
+            base = is_base ? o[first].reg : 0;
+        }
+        else if (statement.count == first + 2)
+        {
+            imm = immediate(o[first], statement.line);
+            base = reg(o[first + 1], statement.line);
+        }
+        else
+            fail(statement.line, "expected a memory operand");
+    }
+
+    void encode(const asm_statement &statement, uint64_t pc)
+    {
+        const asm_operand *o = statement.operands;
+        uint32_t at = statement.line;
+        uint8_t f3 = statement.funct3;
+        int64_t imm;
+        uint8_t base;
+        switch (statement.format)
+        {
+        case FMT_R:
+            expect(statement, 3);
+            words.push_back(r_type(statement.funct7, reg(o[2], at), reg(o[1], at), f3, reg(o[0], at)));
+            break;
+        case FMT_I:
+            expect(statement, 3);
+            words.push_back(i_type(immediate(o[2], at), reg(o[1], at), f3, reg(o[0], at), 0x13));
+            break;
+        case FMT_SHIFT:
+        {
+            expect(statement, 3);
+            int64_t shamt = value(o[2], at);
+            if (shamt < 0 || shamt > 63)
+                fail(at, "shift amount out of range");
+            words.push_back(i_type(shamt | (int64_t)statement.funct7 << 5, reg(o[1], at), f3, reg(o[0], at), 0x13));
+            break;
+        }
+        case FMT_LOAD:
+            memory_operand(statement, 1, imm, base);
+            words.push_back(i_type(imm, base, f3, reg(o[0], at), 0x03));
+            break;
+        case FMT_STORE:
+            memory_operand(statement, 1, imm, base);
+            words.push_back(s_type(imm, reg(o[0], at), base, f3));
+            break;
+        case FMT_BRANCH:
+            expect(statement, 3);
+            words.push_back(b_type(offset(o[2], pc, 13, at), reg(o[1], at), reg(o[0], at), f3));
+            break;
+        case FMT_JAL:
+            if (statement.count == 1)
+                words.push_back(j_type(offset(o[0], pc, 21, at), 1));
+            else
+            {
+                expect(statement, 2);
+                words.push_back(j_type(offset(o[1], pc, 21, at), reg(o[0], at)));
+            }
+            break;
+        case FMT_JALR:
+            if (statement.count == 1)
+                words.push_back(i_type(0, reg(o[0], at), 0, 1, 0x67));
+            else if (statement.count == 3 && o[1].kind == asm_operand::Register)
+                words.push_back(i_type(immediate(o[2], at), o[1].reg, 0, reg(o[0], at), 0x67));
+            else
+            {
+                memory_operand(statement, 1, imm, base);
+                words.push_back(i_type(imm, base, 0, reg(o[0], at), 0x67));
+            }
+            break;
+        case FMT_SYSTEM:
+            expect(statement, 0);
+            words.push_back(i_type(statement.funct7, 0, 0, 0, 0x73));
+            break;
+        case FMT_CSR:
+            expect(statement, 3);
+            words.push_back(i_type(csr(o[1], at), csr_source(o[2], f3, at), f3, reg(o[0], at), 0x73));
+            break;
+        case PSEUDO_NOP:
+            expect(statement, 0);
+            words.push_back(i_type(0, 0, 0, 0, 0x13));
+            break;
+        case PSEUDO_LI:
+            materialize(o[1].value, reg(o[0], at), words);
+            break;
+        case PSEUDO_MV:
+            expect(statement, 2);
+            words.push_back(i_type(0, reg(o[1], at), 0, reg(o[0], at), 0x13));
+            break;
+        case PSEUDO_NOT:
+            expect(statement, 2);
+            words.push_back(i_type(-1, reg(o[1], at), 4, reg(o[0], at), 0x13));
+            break;
+        case PSEUDO_NEG:
+            expect(statement, 2);
+            words.push_back(r_type(0x20, reg(o[1], at), 0, 0, reg(o[0], at)));
+            break;
+        case PSEUDO_SEQZ:
+            expect(statement, 2);
+            words.push_back(i_type(1, reg(o[1], at), 3, reg(o[0], at), 0x13));
+            break;
+        case PSEUDO_SNEZ:
+            expect(statement, 2);
+            words.push_back(r_type(0, reg(o[1], at), 0, 3, reg(o[0], at)));
+            break;
+        case PSEUDO_J:
+            expect(statement, 1);
+            words.push_back(j_type(offset(o[0], pc, 21, at), 0));
+            break;
+        case PSEUDO_JR:
+            expect(statement, 1);
+            words.push_back(i_type(0, reg(o[0], at), 0, 0, 0x67));
+            break;
+        case PSEUDO_RET:
+            expect(statement, 0);
+            words.push_back(i_type(0, 1, 0, 0, 0x67));
+            break;
+        case PSEUDO_CALL:
+            expect(statement, 1);
+            words.push_back(j_type(offset(o[0], pc, 21, at), 1));
+            break;
+        case PSEUDO_BRANCH_ZERO:
+            expect(statement, 2);
+            words.push_back(b_type(offset(o[1], pc, 13, at), 0, reg(o[0], at), f3));
+            break;
+        case PSEUDO_CSR_READ:
+            expect(statement, 2);
+            words.push_back(i_type(csr(o[1], at), 0, f3, reg(o[0], at), 0x73));
+            break;
+        case PSEUDO_CSR_WRITE:
+            expect(statement, 2);
+            words.push_back(i_type(csr(o[0], at), csr_source(o[1], f3, at), f3, 0, 0x73));
+            break;
+        case PSEUDO_RD_COUNTER:
+            expect(statement, 1);
+            words.push_back(i_type(0xC00 | statement.funct7, 0, f3, reg(o[0], at), 0x73));
+            break;
+        }
+    }
+
+    // Pass 2 (second half): encode the code and fill in data items that named labels
+    void generate()
+    {
+        out.instructions.reserve(statements.size());
+        uint64_t pc = 0;
+        for (const asm_statement &statement : statements)
+        {
+            switch (statement.kind)
+            {
+            case STMT_LABEL:
+                continue;
+            case STMT_ALIGN:
+                for (size_t n = nops_to_align(pc, statement.operands[0].value); n; n--, pc += 4)
+                    out.instructions.push_back(i_type(0, 0, 0, 0, 0x13));
+                continue;
+            case STMT_WORD:
+                words.assign(1, statement.operands[0].value);
+                break;
+            case STMT_INSTRUCTION:
+                words.clear();
+                encode(statement, pc);
+                break;
+            }
+            out.instructions.insert(out.instructions.end(), words.begin(), words.end());
+            pc += 4 * words.size();
+        }
+
+        for (const data_fixup &fixup : fixups)
+            out.data[fixup.address] = sign_extend(value(fixup.value, fixup.line), fixup.width);
+    }
+
+public:
+    explicit source_assembler(const string &text) : source(text) {}
+
+    assembled_program run()
+    {
+        parse();
+        layout();
+        generate();
+        return move(out);
+    }
+};
+
+bool is_assembly_source(const string &text)
+{
+    size_t i = 0, n = text.size();
+    while (i < n)
+    {
+        char c = text[i];
+        if (c == ' ' || c == '\t' || c == '\r' || c == '\n')
+        {
+            i++;
+            continue;
+        }
+        if (c == '#')
+        {
+            while (i < n && text[i] != '\n')
+                i++;
+            continue;
+        }
+        size_t j = i;
+        while (j < n && isxdigit((unsigned char)text[j]))
+            j++;
+        return !(j - i == 8 && (j == n || isspace((unsigned char)text[j])));
+    }
+    return false;
+}
+
+assembled_program assemble(const string &source)
+{
+    return source_assembler(source).run();
+}
@@ -0,0 +1,46 @@
+#ifndef ASSEMBLER_HPP
+#define ASSEMBLER_HPP
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// Two-pass assembler for program files written as RISC-V assembly instead of
+// a hand-assembled "hex [assembly]" listing.
+//
+// Instructions are the ones the pipeline implements (R/I-type ALU, loads,
+// stores, beq, bne, jal, jalr, the Zicsr set) plus ecall and ebreak, with x
+// or ABI register names. Memory operands may be written "imm(rs1)" or, as in
+// the listings, "imm rs1". Branch and jump targets are labels or byte
+// offsets. CSRs are numbers or the names cycle, time, instret and roi.
+//
+// Pseudo-instructions: nop, li, la, mv, not, neg, seqz, snez, j, jr, ret,
+// call, beqz, bnez, csrr, csrw/csrs/csrc (and -i forms), rdcycle, rdtime,
+// rdinstret, and the one-operand forms of jal and jalr. There is no lui
+// in the pipeline, so li builds large constants from addi and slli.
+//
+// Directives: .text, .data, .word, .dword, .half, .byte, .space/.zero,
+// .align (power of two), .org (data only), .equ/.set, and .globl/.section,
+// which are accepted and ignored. Code starts at pc 0 and data at address 0;
+// each data item is one memory cell at its byte address.
+//
+// li and la may use .equ symbols, data labels and code labels defined above
+// them; their length has to be known before the code is laid out.
+
+struct assembled_program
+{
+    vector<uint32_t> instructions;
+    // Initial data memory from the .data section
+    map<uint64_t, int64_t> data;
+};
+
+// True unless the first statement starts with an 8-digit hex instruction word
+bool is_assembly_source(const string &text);
+
+// Throws runtime_error naming the line of the first error
+assembled_program assemble(const string &source);
+
+#endif // ASSEMBLER_HPP
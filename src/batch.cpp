@@ -0,0 +1,345 @@
+#include "batch.hpp"
+#include <stdexcept>
+
+BatchSimulator::BatchSimulator(const vector<uint32_t> &program, size_t lanes)
+    : memories(lanes), lane_count(lanes)
+{
+    if (lanes == 0 || lanes > batch_lanes)
+        throw invalid_argument("batch lanes must be between 1 and " + to_string(batch_lanes));
+
+    code.reserve(program.size());
+    for (uint32_t instruction : program)
+        code.push_back(decode(instruction));
+
+    // Unused lanes start outside the program and never issue
+    for (size_t lane = lane_count; lane < batch_lanes; lane++)
+        pc[lane] = UINT64_MAX;
+}
+
+void BatchSimulator::set_register(size_t lane, int reg, int64_t value)
+{
+    if (lane >= lane_count || reg <= 0 || reg >= 32)
+        throw out_of_range("no register x" + to_string(reg) + " in lane " + to_string(lane));
+    registers[reg][lane] = value;
+}
+
+/*                           Lane-parallel kernels                            */
+
+void BatchSimulator::write_lanes(uint8_t rd, const int64_t *result, const lane_mask &mask)
+{
+    int64_t *dst = registers[rd];
+    for (size_t l = 0; l < batch_lanes; l++)
+        dst[l] = (result[l] & mask[l]) | (dst[l] & ~mask[l]);
+}
+
+void BatchSimulator::advance_lanes(uint64_t bytes, const lane_mask &mask)
+{
+    for (size_t l = 0; l < batch_lanes; l++)
+        pc[l] += bytes & mask[l];
+}
+
+template <ALU::Operation OP>
+void BatchSimulator::op_alu_reg(BatchSimulator &sim, const decoded_op &op, const lane_mask &mask)
+{
+    const int64_t *a = sim.registers[op.rs1];
+    const int64_t *b = sim.registers[op.rs2];
+    alignas(64) int64_t result[batch_lanes];
+    for (size_t l = 0; l < batch_lanes; l++)
+        result[l] = ALU::compute(a[l], b[l], OP);
+    sim.write_lanes(op.rd, result, mask);
+}
+
+template <ALU::Operation OP>
+void BatchSimulator::op_alu_imm(BatchSimulator &sim, const decoded_op &op, const lane_mask &mask)
+{
+    const int64_t *a = sim.registers[op.rs1];
+    alignas(64) int64_t result[batch_lanes];
+    for (size_t l = 0; l < batch_lanes; l++)
+        result[l] = ALU::compute(a[l], op.imm, OP);
+    sim.write_lanes(op.rd, result, mask);
+}
+
+// Each lane has its own sparse memory, so loads and stores walk the active lanes
+void BatchSimulator::op_load(BatchSimulator &sim, const decoded_op &op, const lane_mask &mask)
+{
+    alignas(64) int64_t result[batch_lanes] = {};
+    for (size_t l = 0; l < sim.lane_count; l++)
+    {
+        if (!mask[l])
+            continue;
+        uint64_t address = sim.registers[op.rs1][l] + op.imm;
+        if (address >= mmio_base)
+        {
+            bool cycle = mmio_bus::slot(address) == mmio_bus::slot(mmio_base + MMIO_CYCLE);
+            result[l] = cycle ? sim.retired_count[l] + sim.run_position : 0;
+            continue;
+        }
+        auto &memory = sim.memories[l].data_memory;
+        auto it = memory.find(address);
+        result[l] = (it == memory.end()) ? 0 : it->second;
+    }
+    sim.write_lanes(op.rd, result, mask);
+}
+
+void BatchSimulator::op_store(BatchSimulator &sim, const decoded_op &op, const lane_mask &mask)
+{
+    for (size_t l = 0; l < sim.lane_count; l++)
+    {
+        if (!mask[l])
+            continue;
+        uint64_t address = sim.registers[op.rs1][l] + op.imm;
+        if (address < mmio_base)
+        {
+            sim.memories[l].data_memory[address] = sim.registers[op.rs2][l];
+        }
+        else if (mmio_bus::slot(address) == mmio_bus::slot(mmio_base + MMIO_EXIT))
+        {
+            // The lane stops issuing once the current run ends
+            sim.exited[l] = true;
+            sim.stop_run = true;
+            sim.exit_codes[l] = sim.registers[op.rs2][l];
+        }
+    }
+}
+
+void BatchSimulator::op_beq(BatchSimulator &sim, const decoded_op &op, const lane_mask &mask)
+{
+    const int64_t *a = sim.registers[op.rs1];
+    const int64_t *b = sim.registers[op.rs2];
+    for (size_t l = 0; l < batch_lanes; l++)
+        sim.pc[l] += ((a[l] == b[l]) ? op.imm : 4) & mask[l];
+}
+
+void BatchSimulator::op_bne(BatchSimulator &sim, const decoded_op &op, const lane_mask &mask)
+{
+    const int64_t *a = sim.registers[op.rs1];
+    const int64_t *b = sim.registers[op.rs2];
+    for (size_t l = 0; l < batch_lanes; l++)
+        sim.pc[l] += ((a[l] != b[l]) ? op.imm : 4) & mask[l];
+}
+
+void BatchSimulator::op_jal(BatchSimulator &sim, const decoded_op &op, const lane_mask &mask)
+{
+    alignas(64) int64_t link[batch_lanes];
+    for (size_t l = 0; l < batch_lanes; l++)
+    {
+        link[l] = sim.pc[l] + 4;
+        sim.pc[l] += op.imm & mask[l];
+    }
+    if (op.rd != 0)
+        sim.write_lanes(op.rd, link, mask);
+}
+
+void BatchSimulator::op_jalr(BatchSimulator &sim, const decoded_op &op, const lane_mask &mask)
+{
+    alignas(64) int64_t link[batch_lanes];
+    const int64_t *base = sim.registers[op.rs1];
+    for (size_t l = 0; l < batch_lanes; l++)
+    {
+        link[l] = sim.pc[l] + 4;
+        uint64_t target = base[l] + op.imm;
+        sim.pc[l] = (target & mask[l]) | (sim.pc[l] & ~mask[l]);
+    }
+    if (op.rd != 0)
+        sim.write_lanes(op.rd, link, mask);
+}
+
+// Counter CSRs read each lane's retired count, like the cycle register; imm is the CSR number
+void BatchSimulator::op_csr(BatchSimulator &sim, const decoded_op &op, const lane_mask &mask)
+{
+    bool counter = op.imm == CSR_CYCLE || op.imm == CSR_TIME || op.imm == CSR_INSTRET;
+    alignas(64) int64_t result[batch_lanes] = {};
+    for (size_t l = 0; l < batch_lanes; l++)
+        result[l] = counter ? sim.retired_count[l] + sim.run_position : 0;
+    sim.write_lanes(op.rd, result, mask);
+}
+
+void BatchSimulator::op_next(BatchSimulator &, const decoded_op &, const lane_mask &)
+{
+}
+
+BatchSimulator::kernel BatchSimulator::alu_kernel(ALU::Operation operation, bool immediate)
+{
+#define ALU_CASE(name)              \
+    case ALU::Operation::name:      \
+        return immediate ? &op_alu_imm<ALU::Operation::name> : &op_alu_reg<ALU::Operation::name>;
+
+    switch (operation)
+    {
+        ALU_CASE(ADD)
+        ALU_CASE(SUB)
+        ALU_CASE(AND)
+        ALU_CASE(OR)
+        ALU_CASE(XOR)
+        ALU_CASE(SLL)
+        ALU_CASE(SRL)
+        ALU_CASE(SRA)
+        ALU_CASE(SLT)
+        ALU_CASE(SLTU)
+    }
+#undef ALU_CASE
+    return &op_next;
+}
+
+BatchSimulator::decoded_op BatchSimulator::decode(uint32_t instruction)
+{
+    uint32_t opcode = instruction & 0x7F;
+    uint32_t funct3 = (instruction >> 12) & 0x7;
+
+    imm_gen gen;
+    gen.instruction = instruction;
+    gen.generate();
+
+    decoded_op op;
+    op.fn = &op_next;
+    op.rd = (instruction >> 7) & 0x1F;
+    op.rs1 = (instruction >> 15) & 0x1F;
+    op.rs2 = (instruction >> 20) & 0x1F;
+    op.imm = gen.extended;
+    op.control = false;
+
+    // Same instruction coverage as FunctionalSimulator::translate
+    switch (opcode)
+    {
+    case 0x33:
+        if (op.rd != 0)
+            op.fn = alu_kernel(Processor::decode_alu_op(instruction, 2), false);
+        break;
+    case 0x13:
+        if (op.rd != 0)
+            op.fn = alu_kernel(Processor::decode_alu_op(instruction, 2), true);
+        break;
+    case 0x03:
+        if (op.rd != 0)
+            op.fn = &op_load;
+        break;
+    case 0x23:
+        op.fn = &op_store;
+        break;
+    case 0x63:
+        if (funct3 == 0x0 || funct3 == 0x1)
+        {
+            op.fn = (funct3 == 0x0) ? &op_beq : &op_bne;
+            op.control = true;
+        }
+        break;
+    case 0x6F:
+        op.fn = &op_jal;
+        op.control = true;
+        break;
+    case 0x67:
+        op.fn = &op_jalr;
+        op.control = true;
+        break;
+    case 0x73:
+        if (is_csr_instruction(instruction) && op.rd != 0)
+        {
+            op.fn = &op_csr;
+            op.imm = csr_number(instruction);
+        }
+        break;
+    }
+    return op;
+}
+
+/*                               Scheduling                                   */
+
+uint64_t BatchSimulator::issue(uint64_t budget)
+{
+    // Reconverge on the lowest PC any live lane is waiting at
+    uint64_t issue_pc = UINT64_MAX;
+    size_t live = 0;
+    for (size_t l = 0; l < lane_count; l++)
+    {
+        if (lane_live(l))
+        {
+            live++;
+            issue_pc = min(issue_pc, pc[l]);
+        }
+    }
+    if (live == 0 || budget == 0)
+        return 0;
+
+    // Stop the run where the next group of lanes is waiting so they can merge
+    alignas(64) lane_mask mask;
+    uint64_t next_waiting = UINT64_MAX;
+    size_t issued = 0;
+    for (size_t l = 0; l < batch_lanes; l++)
+    {
+        // Exited lanes may sit at a PC the others still reach
+        mask[l] = (l < lane_count && !exited[l] && pc[l] == issue_pc) ? -1 : 0;
+        if (mask[l])
+            issued++;
+        else if (l < lane_count && lane_live(l))
+            next_waiting = min(next_waiting, pc[l]);
+    }
+
+    // Straight-line kernels leave the PCs alone; they move once at the end of
+    // the run, or just before a control instruction that needs them
+    uint64_t at = issue_pc;
+    uint64_t count = 0;
+    stop_run = false;
+    while (true)
+    {
+        const decoded_op &op = code[at / 4];
+        run_position = count;
+        if (op.control)
+        {
+            advance_lanes(at - issue_pc, mask);
+            op.fn(*this, op, mask);
+            count++;
+            break;
+        }
+        op.fn(*this, op, mask);
+        count++;
+        at += 4;
+        if (count == budget || at / 4 >= code.size() || at == next_waiting || stop_run)
+        {
+            advance_lanes(at - issue_pc, mask);
+            break;
+        }
+    }
+
+    for (size_t l = 0; l < batch_lanes; l++)
+        retired_count[l] += count & mask[l];
+    counters.steps += count;
+    counters.lane_instructions += count * issued;
+    if (issued != live)
+        counters.divergent_steps += count;
+    return count;
+}
+
+bool BatchSimulator::step()
+{
+    return issue(1) != 0;
+}
+
+uint64_t BatchSimulator::run(uint64_t max_steps)
+{
+    uint64_t ran = 0;
+    while (ran < max_steps)
+    {
+        uint64_t count = issue(max_steps - ran);
+        if (count == 0)
+            break;
+        ran += count;
+    }
+    return ran;
+}
+
+void BatchSimulator::print_state(ostream &out) const
+{
+    for (size_t l = 0; l < lane_count; l++)
+    {
+        out << "lane " << l << ": " << retired_count[l] << " instructions\n";
+        for (int i = 0; i < 32; i++)
+        {
+            if (registers[i][l] != 0)
+                out << "  x" << i << " = " << registers[i][l] << "\n";
+        }
+        for (const auto &entry : memories[l].data_memory)
+            out << "  mem[" << entry.first << "] = " << entry.second << "\n";
+    }
+    out << "\nSteps: " << counters.steps << ", lane instructions: " << counters.lane_instructions
+        << ", divergent steps: " << counters.divergent_steps << "\n";
+}
@@ -0,0 +1,105 @@
+#ifndef BATCH_HPP
+#define BATCH_HPP
+
+#include "processor.hpp"
+
+// Runs one program over many independent input sets in lockstep. Register
+// state is structure-of-arrays (registers[reg][lane]) so each ALU instruction
+// is one loop over the lanes that the compiler turns into AVX2/AVX-512 code.
+// Lanes that take different branches are masked off: every step issues the
+// lowest PC any live lane is waiting at, for exactly the lanes at that PC, so
+// divergent lanes reconverge as soon as their paths meet again. The lane mask
+// is computed once per straight-line run, not per instruction.
+// Architectural semantics match FunctionalSimulator. Of the MMIO devices, a
+// lane may exit (stopping just that lane) and read the cycle register, which
+// counts its retired instructions; console writes are dropped. The cycle, time
+// and instret CSRs read the same count; the roi CSR reads as zero.
+
+static const size_t batch_lanes = 16;
+
+class BatchSimulator
+{
+public:
+    // All-ones for lanes taking part in the current step, zero otherwise
+    typedef int64_t lane_mask[batch_lanes];
+
+    struct decoded_op;
+    typedef void (*kernel)(BatchSimulator &sim, const decoded_op &op, const lane_mask &mask);
+
+    struct decoded_op
+    {
+        kernel fn;
+        uint8_t rd;
+        uint8_t rs1;
+        uint8_t rs2;
+        bool control; // may change the PC of any lane other than by +4
+        int64_t imm;
+    };
+
+    struct stats
+    {
+        uint64_t steps = 0;             // instructions issued for the batch
+        uint64_t lane_instructions = 0; // instructions retired summed over lanes
+        uint64_t divergent_steps = 0;   // steps issued for only part of the live lanes
+    };
+
+    alignas(64) int64_t registers[32][batch_lanes] = {};
+    uint64_t pc[batch_lanes] = {};
+
+private:
+    vector<decoded_op> code;
+    vector<data_memory> memories;
+    size_t lane_count;
+    uint64_t retired_count[batch_lanes] = {};
+    bool exited[batch_lanes] = {};
+    int64_t exit_codes[batch_lanes] = {};
+    uint64_t run_position = 0; // instructions already issued in the current straight-line run
+    bool stop_run = false;     // a lane exited, so the run must end after this instruction
+    stats counters;
+
+    template <ALU::Operation OP>
+    static void op_alu_reg(BatchSimulator &sim, const decoded_op &op, const lane_mask &mask);
+    template <ALU::Operation OP>
+    static void op_alu_imm(BatchSimulator &sim, const decoded_op &op, const lane_mask &mask);
+    static void op_load(BatchSimulator &sim, const decoded_op &op, const lane_mask &mask);
+    static void op_store(BatchSimulator &sim, const decoded_op &op, const lane_mask &mask);
+    static void op_beq(BatchSimulator &sim, const decoded_op &op, const lane_mask &mask);
+    static void op_bne(BatchSimulator &sim, const decoded_op &op, const lane_mask &mask);
+    static void op_jal(BatchSimulator &sim, const decoded_op &op, const lane_mask &mask);
+    static void op_jalr(BatchSimulator &sim, const decoded_op &op, const lane_mask &mask);
+    static void op_csr(BatchSimulator &sim, const decoded_op &op, const lane_mask &mask);
+    static void op_next(BatchSimulator &sim, const decoded_op &op, const lane_mask &mask);
+
+    static kernel alu_kernel(ALU::Operation operation, bool immediate);
+    static decoded_op decode(uint32_t instruction);
+
+    // Write result into rd for masked lanes only
+    void write_lanes(uint8_t rd, const int64_t *result, const lane_mask &mask);
+    void advance_lanes(uint64_t bytes, const lane_mask &mask);
+    // Issue up to budget straight-line instructions for the lanes at the lowest PC
+    uint64_t issue(uint64_t budget);
+
+public:
+    BatchSimulator(const vector<uint32_t> &program, size_t lanes = batch_lanes);
+
+    size_t lanes() const { return lane_count; }
+    bool lane_live(size_t lane) const { return !exited[lane] && pc[lane] % 4 == 0 && pc[lane] / 4 < code.size(); }
+    bool lane_exited(size_t lane) const { return exited[lane]; }
+    int64_t lane_exit_code(size_t lane) const { return exit_codes[lane]; }
+
+    // Per-lane initial state
+    void set_register(size_t lane, int reg, int64_t value);
+    int64_t register_value(size_t lane, int reg) const { return registers[reg][lane]; }
+    data_memory &memory(size_t lane) { return memories.at(lane); }
+
+    // Issue one instruction for the lanes at the lowest live PC; false once every lane has left the program
+    bool step();
+    // Run until every lane has finished or max_steps batch steps have issued
+    uint64_t run(uint64_t max_steps);
+
+    uint64_t retired(size_t lane) const { return retired_count[lane]; }
+    const stats &statistics() const { return counters; }
+    void print_state(ostream &out) const;
+};
+
+#endif // BATCH_HPP
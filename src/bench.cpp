@@ -0,0 +1,229 @@
+// Host throughput of the cycle loop: simulated cycles per second for both
+// pipelines on a loop with a load-use stall, a store and a taken branch, with
+// the diagram off, recorded inline, and recorded on a second thread. Then the
+// register file alone: one decode read and one write-back per cycle, for the
+// pipeline's 2R1W file and a 4R2W one as a wide-issue core would use. Last,
+// stall decisions for many pipelines at once, batched (hazard_batch.hpp)
+// against one Forward_HazardDetectionUnit call per pipeline, and an input
+// sweep over an ALU loop: BatchSimulator lanes in lockstep against the
+// functional engine running the same lanes one after another. The functional
+// engine alone runs that loop too, interpreted and from translated blocks.
+//
+//   ./procsim_bench [cycles]   (make bench)
+//
+// The default build is unoptimised; for figures worth comparing, build with
+// make clean && make bench CXXFLAGS='-std=c++17 -O2 -pthread'
+
+#include "assembler.hpp"
+#include "batch.hpp"
+#include "bench_program.hpp"
+#include "ds.hpp"
+#include "functional.hpp"
+#include "hazard_batch.hpp"
+#include "simulator.hpp"
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+static double cycles_per_second(PipelineMode mode, uint64_t cycles, bool diagram, bool threaded)
+{
+    Simulator sim(mode);
+    sim.record_diagram(diagram);
+    sim.set_threaded(threaded);
+    sim.load_buffer(bench_program);
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t ran = sim.run(cycles);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (ran != cycles)
+        throw std::runtime_error("benchmark loop finished after " + std::to_string(ran) + " cycles");
+    return ran / seconds;
+}
+
+// Keeps the register file and stall loops from being optimized away
+static volatile int64_t register_file_sink;
+
+// Host nanoseconds per register file cycle: every read port and write port
+// used once, indices from a fixed pseudo-random stream
+template <unsigned READS, unsigned WRITES>
+static double register_file_ns(uint64_t cycles)
+{
+    register_file<READS, WRITES> file;
+    uint32_t seed = 12345;
+    int64_t sink = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t c = 0; c < cycles; c++)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        for (unsigned p = 0; p < READS; p++)
+            file.set_read(p, seed >> (5 * p + 2));
+        file.read();
+        file.bypass(true, seed >> 27, (int64_t)c);
+        for (unsigned p = 0; p < READS; p++)
+            sink += file.data(p);
+        for (unsigned p = 0; p < WRITES; p++)
+            file.set_write(p, true, seed >> (5 * p + 12), sink);
+        file.write();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    register_file_sink = sink;
+    return seconds * 1e9 / cycles;
+}
+
+// Host nanoseconds per pipeline for one cycle's load-use and branch stall
+// decision, over lanes pipelines; batched when batched, else the scalar unit
+static double stall_decision_ns(uint64_t decisions, bool batched)
+{
+    const size_t lanes = 4096;
+    std::mt19937 rng(1);
+    std::vector<uint8_t> fields[9];
+    for (auto &field : fields)
+    {
+        field.resize(lanes);
+        for (uint8_t &v : field)
+            v = (uint8_t)(rng() % 6);
+    }
+    for (int f = 2; f < 9; f++)
+        if (f != 3 && f != 6)
+            for (uint8_t &v : fields[f])
+                v &= 1;
+
+    hazard_lanes l;
+    l.count = lanes;
+    l.rs1 = fields[0].data();
+    l.rs2 = fields[1].data();
+    l.is_branch = fields[2].data();
+    l.id_ex_rd = fields[3].data();
+    l.id_ex_regWrite = fields[4].data();
+    l.id_ex_memRead = fields[5].data();
+    l.ex_mem_rd = fields[6].data();
+    l.ex_mem_regWrite = fields[7].data();
+    l.ex_mem_memRead = fields[8].data();
+    std::vector<uint8_t> stall(lanes);
+
+    uint64_t rounds = decisions / lanes + 1;
+    auto start = std::chrono::steady_clock::now();
+    for (uint64_t r = 0; r < rounds; r++)
+    {
+        if (batched)
+        {
+            detect_stalls_batch(l, true, stall.data());
+            continue;
+        }
+        for (size_t i = 0; i < lanes; i++)
+        {
+            register_scoreboard board;
+            board.loading = dest_mask(l.id_ex_rd[i], l.id_ex_memRead[i]);
+            board.busy = dest_mask(l.id_ex_rd[i], l.id_ex_regWrite[i] || l.id_ex_memRead[i]) |
+                         dest_mask(l.ex_mem_rd[i], l.ex_mem_regWrite[i] || l.ex_mem_memRead[i]);
+            Forward_HazardDetectionUnit unit;
+            unit.if_id_ins = l.is_branch[i] ? 0x63 : 0x33;
+            unit.detect(board, l.rs1[i], l.rs2[i]);
+            stall[i] = unit.stall;
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    register_file_sink = stall[rng() % lanes];
+    return seconds * 1e9 / (rounds * lanes);
+}
+
+// ALU loop for the input sweep; a0 sets the trip count of each lane
+static const char *const sweep_program = R"(
+loop:
+    add t1, t1, a0
+    xor t2, t2, t1
+    slli t3, t1, 3
+    sub t4, t3, t2
+    or t5, t5, t4
+    addi a0, a0, -1
+    bnez a0, loop
+)";
+
+// Host lane instructions per second for a sweep of batch_lanes inputs with
+// about instructions in total; in lockstep when batched, else one
+// FunctionalSimulator per lane in turn
+static double lane_instructions_per_second(uint64_t instructions, bool batched)
+{
+    std::vector<uint32_t> program = assemble(sweep_program).instructions;
+    // Trip counts differ slightly so the lanes leave the loop one by one
+    uint64_t trips = instructions / (7 * batch_lanes) + 1;
+    uint64_t retired = 0;
+
+    auto start = std::chrono::steady_clock::now();
+    if (batched)
+    {
+        BatchSimulator sim(program);
+        for (size_t l = 0; l < batch_lanes; l++)
+            sim.set_register(l, 10, (int64_t)(trips + l));
+        sim.run(UINT64_MAX);
+        for (size_t l = 0; l < batch_lanes; l++)
+            retired += sim.retired(l);
+    }
+    else
+    {
+        for (size_t l = 0; l < batch_lanes; l++)
+        {
+            FunctionalSimulator sim(program);
+            sim.registers[10] = (int64_t)(trips + l);
+            retired += sim.run(UINT64_MAX);
+        }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return retired / seconds;
+}
+
+// Host instructions per second for FunctionalSimulator on the sweep loop,
+// from translated blocks when blocks, else decoding every instruction
+static double functional_instructions_per_second(uint64_t instructions, bool blocks)
+{
+    FunctionalSimulator sim(assemble(sweep_program).instructions);
+    sim.set_block_cache(blocks);
+    sim.registers[10] = (int64_t)(instructions / 7 + 1);
+
+    auto start = std::chrono::steady_clock::now();
+    uint64_t retired = sim.run(UINT64_MAX);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return retired / seconds;
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        uint64_t cycles = argc > 1 ? std::stoull(argv[1]) : 5000000;
+        std::cout << cycles << " cycles per run\n";
+        for (PipelineMode mode : {PipelineMode::Forward, PipelineMode::NoForward})
+        {
+            for (int variant = 0; variant < 3; variant++)
+            {
+                double rate = cycles_per_second(mode, cycles, variant > 0, variant == 2);
+                static const char *const names[] = {"no diagram", "diagram   ", "threaded  "};
+                std::cout << "  " << std::left << std::setw(10) << pipeline_mode_name(mode) << names[variant]
+                          << ": " << rate / 1e6 << " M cycles/s (" << 1e9 / rate << " ns/cycle)\n";
+            }
+        }
+        std::cout << "  register file 2R1W: " << register_file_ns<2, 1>(cycles) << " ns/cycle\n"
+                  << "  register file 4R2W: " << register_file_ns<4, 2>(cycles) << " ns/cycle\n"
+                  << "  stall decisions, scalar unit: " << stall_decision_ns(cycles, false) << " ns/pipeline\n"
+                  << "  stall decisions, batched (" << hazard_batch_isa() << "): " << stall_decision_ns(cycles, true)
+                  << " ns/pipeline\n"
+                  << "  functional, interpreted:   " << functional_instructions_per_second(cycles * 4, false) / 1e6
+                  << " M instructions/s\n"
+                  << "  functional, block cache:   " << functional_instructions_per_second(cycles * 4, true) / 1e6
+                  << " M instructions/s\n"
+                  << "  input sweep, " << batch_lanes << " lanes sequential: "
+                  << lane_instructions_per_second(cycles * 20, false) / 1e6 << " M lane instructions/s\n"
+                  << "  input sweep, " << batch_lanes << " lanes batched:    "
+                  << lane_instructions_per_second(cycles * 20, true) / 1e6 << " M lane instructions/s\n";
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Error during benchmark: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,16 @@
+#ifndef BENCH_PROGRAM_HPP
+#define BENCH_PROGRAM_HPP
+
+// Cycle-loop workload shared by procsim_bench and the regression timing: a
+// loop with a load-use stall, a store and a taken branch that never finishes,
+// so any cycle budget is spent entirely in the steady state.
+static const char *const bench_program =
+    "00002083 lw x1 0 x0\n"
+    "001080b3 add x1 x1 x1\n"
+    "00102423 sw x1 8 x0\n"
+    "00108093 addi x1 x1 1\n"
+    "400080b3 sub x1 x1 x0\n"
+    "fe0006e3 beq x0 x0 -20\n"
+    "00000013 addi x0 x0 0\n";
+
+#endif // BENCH_PROGRAM_HPP
@@ -0,0 +1,126 @@
+#ifndef CSR_HPP
+#define CSR_HPP
+
+#include <cstdint>
+#include <iostream>
+
+using namespace std;
+
+// Zicsr control and status registers (opcode 0x73, funct3 1-3 and 5-7).
+// cycle, time and instret are read-only views of the engine's counters; time
+// ticks with the core clock. roi is a user CSR marking a region of interest:
+// writing it nonzero opens a region and writing zero closes it, and the
+// simulator reports statistics summed over the marked regions only.
+enum csr_address : uint32_t
+{
+    CSR_ROI = 0x800,
+    CSR_CYCLE = 0xC00,
+    CSR_TIME = 0xC01,
+    CSR_INSTRET = 0xC02
+};
+
+inline bool is_csr_instruction(uint32_t instruction)
+{
+    return (instruction & 0x7F) == 0x73 && ((instruction >> 12) & 0x3) != 0;
+}
+
+inline uint32_t csr_number(uint32_t instruction) { return instruction >> 20; }
+
+// csrrs/csrrc with x0 (or a zero immediate) only read
+inline bool csr_writes(uint32_t instruction)
+{
+    return ((instruction >> 12) & 0x3) == 1 || ((instruction >> 15) & 0x1F) != 0;
+}
+
+// Value the CSR holds after the instruction; rs1_value is ignored by the
+// immediate forms, which use the rs1 field as a 5-bit zero-extended operand
+inline uint64_t csr_new_value(uint32_t instruction, uint64_t old_value, uint64_t rs1_value)
+{
+    uint32_t funct3 = (instruction >> 12) & 0x7;
+    uint64_t source = (funct3 & 0x4) ? (instruction >> 15) & 0x1F : rs1_value;
+    switch (funct3 & 0x3)
+    {
+    case 1:
+        return source;
+    case 2:
+        return old_value | source;
+    default:
+        return old_value & ~source;
+    }
+}
+
+// Event counts the region of interest is measured in
+struct pipeline_counters
+{
+    uint64_t cycles = 0;
+    uint64_t instructions = 0; // retired
+    uint64_t stall_cycles = 0; // fetch held by a hazard or a full store buffer
+    uint64_t flushes = 0;      // fetch slots squashed by a taken branch or jump
+    uint64_t wrong_path = 0;   // instructions fetched into those slots
+
+    pipeline_counters &operator+=(const pipeline_counters &other)
+    {
+        cycles += other.cycles;
+        instructions += other.instructions;
+        stall_cycles += other.stall_cycles;
+        flushes += other.flushes;
+        wrong_path += other.wrong_path;
+        return *this;
+    }
+
+    pipeline_counters operator-(const pipeline_counters &other) const
+    {
+        pipeline_counters d;
+        d.cycles = cycles - other.cycles;
+        d.instructions = instructions - other.instructions;
+        d.stall_cycles = stall_cycles - other.stall_cycles;
+        d.flushes = flushes - other.flushes;
+        d.wrong_path = wrong_path - other.wrong_path;
+        return d;
+    }
+};
+
+// Sums the counters over the regions a program marks through the roi CSR
+struct region_of_interest
+{
+    uint64_t value = 0; // the roi CSR
+    uint64_t regions = 0;
+    pipeline_counters opened_at;
+    pipeline_counters total;
+
+    void write(uint64_t new_value, const pipeline_counters &now)
+    {
+        if (!value && new_value)
+        {
+            opened_at = now;
+            regions++;
+        }
+        else if (value && !new_value)
+        {
+            total += now - opened_at;
+        }
+        value = new_value;
+    }
+
+    // Totals with a region still open counted up to now
+    pipeline_counters measured(const pipeline_counters &now) const
+    {
+        pipeline_counters sum = total;
+        if (value)
+            sum += now - opened_at;
+        return sum;
+    }
+
+    void report(ostream &out, const pipeline_counters &now) const
+    {
+        pipeline_counters m = measured(now);
+        out << "Region of interest: " << regions << " region(s)" << (value ? ", last one still open" : "") << "\n"
+            << "  cycles " << m.cycles << ", instructions " << m.instructions << ", CPI "
+            << (m.instructions ? (double)m.cycles / m.instructions : 0.0) << "\n"
+            << "  stall cycles " << m.stall_cycles << " ("
+            << (m.cycles ? 100.0 * m.stall_cycles / m.cycles : 0.0) << "%), flushes " << m.flushes
+            << ", wrong-path instructions " << m.wrong_path << "\n";
+    }
+};
+
+#endif // CSR_HPP
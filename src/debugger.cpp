@@ -0,0 +1,283 @@
+#include "debugger.hpp"
+#include <iomanip>
+#include <sstream>
+
+Debugger::Debugger(Processor &processor) : cpu(processor)
+{
+    breakpoints.assign(cpu.instr_mem.instructions.size(), false);
+}
+
+StopReason Debugger::step_once()
+{
+    if (cpu.pipeline_drained())
+    {
+        stop_detail = "pipeline drained";
+        return StopReason::Drained;
+    }
+    if (cpu.halted())
+    {
+        stop_detail = "program exited with code " + to_string(cpu.exit_code());
+        return StopReason::Halted;
+    }
+
+    cpu.step();
+
+    if (cpu.reg_file.watch_hit)
+    {
+        cpu.reg_file.watch_hit = false;
+        stop_detail = "write to x" + to_string(cpu.reg_file.watch_reg);
+        return StopReason::RegisterWatch;
+    }
+    if (cpu.data_mem.watch_hit)
+    {
+        cpu.data_mem.watch_hit = false;
+        stop_detail = "write to memory address " + to_string(cpu.data_mem.watch_addr);
+        return StopReason::MemoryWatch;
+    }
+
+    // A breakpoint fires once when its instruction is fetched, not on every stalled cycle
+    uint64_t fetched = cpu.IF_ID.instr_index;
+    if (fetched != last_fetched)
+    {
+        last_fetched = fetched;
+        if (fetched < breakpoints.size() && breakpoints[fetched])
+        {
+            stop_detail = "breakpoint at pc " + to_string(fetched * 4);
+            return StopReason::Breakpoint;
+        }
+    }
+
+    stop_detail.clear();
+    return StopReason::None;
+}
+
+StopReason Debugger::step(uint64_t cycles)
+{
+    for (uint64_t i = 0; i < cycles; i++)
+    {
+        StopReason reason = step_once();
+        if (reason != StopReason::None)
+            return reason;
+    }
+    return StopReason::None;
+}
+
+StopReason Debugger::run(uint64_t max_cycles)
+{
+    StopReason reason = step(max_cycles);
+    if (reason == StopReason::None)
+    {
+        stop_detail = "cycle limit reached";
+        reason = StopReason::MaxCycles;
+    }
+    return reason;
+}
+
+StopReason Debugger::run_until_pc(uint64_t pc, uint64_t max_cycles)
+{
+    return run_until_index(pc / 4, max_cycles);
+}
+
+StopReason Debugger::run_until_index(uint64_t index, uint64_t max_cycles)
+{
+    if (index >= breakpoints.size())
+        return run(max_cycles);
+
+    // Temporary breakpoint, restored to its previous state afterwards
+    bool was_set = breakpoints[index];
+    breakpoints[index] = true;
+    StopReason reason = run(max_cycles);
+    breakpoints[index] = was_set;
+    return reason;
+}
+
+void Debugger::add_breakpoint(uint64_t pc)
+{
+    if (pc / 4 < breakpoints.size())
+        breakpoints[pc / 4] = true;
+}
+
+void Debugger::remove_breakpoint(uint64_t pc)
+{
+    if (pc / 4 < breakpoints.size())
+        breakpoints[pc / 4] = false;
+}
+
+void Debugger::watch_register(uint8_t reg)
+{
+    if (reg < 32)
+        cpu.reg_file.watch_mask |= (1u << reg);
+}
+
+void Debugger::unwatch_register(uint8_t reg)
+{
+    if (reg < 32)
+        cpu.reg_file.watch_mask &= ~(1u << reg);
+}
+
+void Debugger::watch_memory(uint64_t address)
+{
+    cpu.data_mem.add_watch(address);
+}
+
+void Debugger::unwatch_memory(uint64_t address)
+{
+    cpu.data_mem.remove_watch(address);
+}
+
+static string index_string(uint64_t index)
+{
+    return index == SIZE_MAX ? string("-") : to_string(index);
+}
+
+void Debugger::print_pipeline_registers(ostream &out) const
+{
+    const auto &if_id = cpu.IF_ID;
+    const auto &id_ex = cpu.ID_EX;
+    const auto &ex_mem = cpu.EX_MEM;
+    const auto &mem_wb = cpu.MEM_WB;
+
+    out << "cycle " << cpu.cycle_count << "\n";
+    out << "IF/ID : index=" << index_string(if_id.instr_index) << " pc=" << if_id.program_counter
+        << " instr=" << hex << setw(8) << setfill('0') << if_id.instruction << dec << setfill(' ')
+        << " flush=" << if_id.flush << "\n";
+    out << "ID/EX : index=" << index_string(id_ex.instr_index)
+        << " instr=" << hex << setw(8) << setfill('0') << id_ex.instruction << dec << setfill(' ')
+        << " rs1=x" << (int)id_ex.IF_ID_Register_RS1 << " rs2=x" << (int)id_ex.IF_ID_Register_RS2
+        << " rd=x" << (int)id_ex.IF_ID_Register_RD << " imm=" << id_ex.immediate
+        << " regWrite=" << id_ex.regWrite << " memRead=" << id_ex.memRead
+        << " memWrite=" << id_ex.memWrite << " aluSrc=" << id_ex.aluSrc
+        << " aluOp=" << (int)id_ex.aluOp << "\n";
+    out << "EX/MEM: index=" << index_string(ex_mem.instr_index) << " alu=" << ex_mem.alu_result
+        << " write_data=" << ex_mem.write_data << " rd=x" << (int)ex_mem.ID_EX_RegisterRD
+        << " regWrite=" << ex_mem.regWrite << " memRead=" << ex_mem.memRead
+        << " memWrite=" << ex_mem.memWrite << "\n";
+    out << "MEM/WB: index=" << index_string(mem_wb.instr_index) << " alu=" << mem_wb.alu_result
+        << " read_data=" << mem_wb.read_data << " rd=x" << (int)mem_wb.EX_MEM_RegisterRD
+        << " regWrite=" << mem_wb.regWrite << " memToReg=" << mem_wb.memToReg << "\n";
+}
+
+void Debugger::print_registers(ostream &out) const
+{
+    for (int i = 0; i < 32; i++)
+    {
+        out << "x" << setw(2) << left << i << right << " = " << setw(20) << cpu.reg_file.registers[i]
+            << ((i % 4 == 3) ? "\n" : "  ");
+    }
+}
+
+void Debugger::print_memory(ostream &out, uint64_t address) const
+{
+    out << "mem[" << address << "] = " << cpu.memory_value(address) << "\n";
+}
+
+static const char *stop_name(StopReason reason)
+{
+    switch (reason)
+    {
+    case StopReason::MaxCycles:
+        return "cycle limit";
+    case StopReason::Drained:
+        return "finished";
+    case StopReason::Halted:
+        return "exited";
+    case StopReason::Looping:
+        return "infinite loop";
+    case StopReason::TimeLimit:
+        return "time limit";
+    case StopReason::Breakpoint:
+        return "breakpoint";
+    case StopReason::RegisterWatch:
+    case StopReason::MemoryWatch:
+        return "watchpoint";
+    default:
+        return "stepped";
+    }
+}
+
+// "x<n>" or "<n>", rejected unless it names one of x0..x31
+static uint8_t register_number(const string &arg)
+{
+    string digits = !arg.empty() && arg[0] == 'x' ? arg.substr(1) : arg;
+    size_t used = 0;
+    unsigned long reg = stoul(digits, &used, 10);
+    if (used != digits.size() || reg > 31)
+        throw out_of_range("no register " + arg);
+    return (uint8_t)reg;
+}
+
+void Debugger::repl(istream &in, ostream &out, uint64_t max_cycles)
+{
+    string line;
+    out << "(dbg) " << flush;
+    while (getline(in, line))
+    {
+        stringstream ss(line);
+        string cmd, arg;
+        ss >> cmd >> arg;
+
+        try
+        {
+            uint64_t budget = max_cycles > cpu.cycle_count ? max_cycles - cpu.cycle_count : 0;
+            StopReason reason = StopReason::None;
+            bool ran = false;
+
+            if (cmd.empty())
+            {
+            }
+            else if (cmd == "s" || cmd == "step")
+            {
+                reason = step(arg.empty() ? 1 : stoull(arg, nullptr, 0));
+                ran = true;
+            }
+            else if (cmd == "c" || cmd == "continue")
+            {
+                reason = run(budget);
+                ran = true;
+            }
+            else if (cmd == "u" || cmd == "until")
+            {
+                reason = run_until_pc(stoull(arg, nullptr, 0), budget);
+                ran = true;
+            }
+            else if (cmd == "b" || cmd == "break")
+                add_breakpoint(stoull(arg, nullptr, 0));
+            else if (cmd == "d" || cmd == "delete")
+                remove_breakpoint(stoull(arg, nullptr, 0));
+            else if (cmd == "w" || cmd == "watch")
+                watch_register(register_number(arg));
+            else if (cmd == "uw" || cmd == "unwatch")
+                unwatch_register(register_number(arg));
+            else if (cmd == "wm" || cmd == "watchmem")
+                watch_memory(stoull(arg, nullptr, 0));
+            else if (cmd == "uwm" || cmd == "unwatchmem")
+                unwatch_memory(stoull(arg, nullptr, 0));
+            else if (cmd == "p" || cmd == "pipe")
+                print_pipeline_registers(out);
+            else if (cmd == "r" || cmd == "regs")
+                print_registers(out);
+            else if (cmd == "m" || cmd == "mem")
+                print_memory(out, stoull(arg, nullptr, 0));
+            else if (cmd == "q" || cmd == "quit")
+                return;
+            else
+                out << "commands: step [n], continue, until <pc>, break <pc>, delete <pc>,\n"
+                       "          watch x<n>, unwatch x<n>, watchmem <addr>, unwatchmem <addr>,\n"
+                       "          pipe, regs, mem <addr>, quit\n";
+
+            if (ran)
+            {
+                cpu.flush_console();
+                out << "[cycle " << cpu.cycle_count << "] " << stop_name(reason);
+                if (!stop_detail.empty())
+                    out << ": " << stop_detail;
+                out << "\n";
+            }
+        }
+        catch (const exception &)
+        {
+            out << "bad argument: " << arg << "\n";
+        }
+        out << "(dbg) " << flush;
+    }
+}
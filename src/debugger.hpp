@@ -0,0 +1,51 @@
+#ifndef DEBUGGER_HPP
+#define DEBUGGER_HPP
+
+#include "processor.hpp"
+#include <iostream>
+#include <string>
+#include <vector>
+
+class Debugger
+{
+private:
+    Processor &cpu;
+
+    // Breakpoints are kept per instruction index (PC / 4)
+    vector<bool> breakpoints;
+    uint64_t last_fetched = SIZE_MAX;
+
+    string stop_detail;
+
+    // Run one cycle and report what (if anything) should stop execution
+    StopReason step_once();
+
+public:
+    explicit Debugger(Processor &processor);
+
+    // Execution control
+    StopReason step(uint64_t cycles = 1);
+    StopReason run(uint64_t max_cycles);
+    StopReason run_until_pc(uint64_t pc, uint64_t max_cycles);
+    StopReason run_until_index(uint64_t index, uint64_t max_cycles);
+
+    // Breakpoints and watchpoints
+    void add_breakpoint(uint64_t pc);
+    void remove_breakpoint(uint64_t pc);
+    void watch_register(uint8_t reg);
+    void unwatch_register(uint8_t reg);
+    void watch_memory(uint64_t address);
+    void unwatch_memory(uint64_t address);
+
+    // Inspection
+    uint64_t cycle() const { return cpu.cycle_count; }
+    const string &last_stop_detail() const { return stop_detail; }
+    void print_pipeline_registers(ostream &out) const;
+    void print_registers(ostream &out) const;
+    void print_memory(ostream &out, uint64_t address) const;
+
+    // Line-oriented command loop ("help" lists the commands)
+    void repl(istream &in, ostream &out, uint64_t max_cycles);
+};
+
+#endif // DEBUGGER_HPP
@@ -0,0 +1,596 @@
+#include "diagram.hpp"
+#include "disassembler.hpp"
+#include <algorithm>
+#include <cctype>
+#include <sstream>
+#include <stdexcept>
+
+static const char *const stage_names[5] = {"IF", "ID", "EX", "MEM", "WB"};
+static const char *const stage_cells[5] = {" IF  ", " ID  ", " EX  ", " MEM ", " WB  "};
+static const char binary_magic[4] = {'P', 'S', 'D', '1'};
+
+diagram_format parse_diagram_format(const string &name)
+{
+    if (name == "text" || name == "txt")
+        return diagram_format::text;
+    if (name == "csv")
+        return diagram_format::csv;
+    if (name == "json")
+        return diagram_format::json;
+    if (name == "bin" || name == "binary")
+        return diagram_format::binary;
+    throw runtime_error("unknown diagram format: " + name);
+}
+
+const char *diagram_extension(diagram_format format)
+{
+    switch (format)
+    {
+    case diagram_format::csv:
+        return "csv";
+    case diagram_format::json:
+        return "json";
+    case diagram_format::binary:
+        return "bin";
+    default:
+        return "txt";
+    }
+}
+
+void sparse_diagram::reset(const vector<uint32_t> &program)
+{
+    cycles = 0;
+    words = program;
+    labels.clear();
+    cells.assign(words.size(), {});
+    frontier.clear();
+}
+
+void sparse_diagram::reset(const vector<string> &row_labels)
+{
+    cycles = 0;
+    words.clear();
+    labels = row_labels;
+    cells.assign(labels.size(), {});
+    frontier.clear();
+}
+
+string sparse_diagram::label(size_t row) const
+{
+    return row < labels.size() ? labels[row] : instruction_label(words[row]);
+}
+
+string sparse_diagram::stage_text(uint8_t stages, size_t row, uint64_t frontier_index)
+{
+    if (stages == 0)
+    {
+        // For finished or not yet fetched instructions
+        return row < frontier_index ? "  -  " : "     ";
+    }
+
+    // If multiple stages, the first two are joined with '/'
+    string text;
+    int shown = 0;
+    for (int s = 0; s < 5 && shown < 2; s++)
+    {
+        if (stages & (1 << s))
+        {
+            text += (shown ? "/" : "");
+            text += stage_cells[s];
+            shown++;
+        }
+    }
+    return text;
+}
+
+vector<sparse_diagram::visit> sparse_diagram::visits() const
+{
+    vector<visit> result;
+    for (size_t row = 0; row < cells.size(); row++)
+    {
+        const auto &row_cells = cells[row];
+        for (size_t i = 0; i < row_cells.size(); i++)
+        {
+            const cell &c = row_cells[i];
+            bool continues = i > 0 && row_cells[i - 1].cycle + 1 == c.cycle;
+            if (!continues)
+                result.push_back({row, c.cycle, {}});
+
+            auto &runs = result.back().runs;
+            if (continues && runs.back().first == c.stages)
+                runs.back().second++;
+            else
+                runs.push_back({c.stages, 1});
+        }
+    }
+    stable_sort(result.begin(), result.end(), [](const visit &a, const visit &b)
+                { return a.first_cycle < b.first_cycle; });
+    return result;
+}
+
+void sparse_diagram::add_visit(const visit &v)
+{
+    if (v.row >= cells.size())
+        throw runtime_error("diagram visit refers to unknown row " + to_string(v.row));
+    uint64_t cycle = v.first_cycle;
+    for (const auto &run : v.runs)
+    {
+        for (uint32_t i = 0; i < run.second; i++)
+            record(cycle++, v.row, run.first);
+    }
+}
+
+/*                Text encodings of a visit's stage runs                 */
+
+static string runs_to_string(const vector<pair<uint8_t, uint32_t>> &runs)
+{
+    string text;
+    for (const auto &run : runs)
+    {
+        if (!text.empty())
+            text += ' ';
+        bool first = true;
+        for (int s = 0; s < 5; s++)
+        {
+            if (run.first & (1 << s))
+            {
+                text += (first ? "" : "/");
+                text += stage_names[s];
+                first = false;
+            }
+        }
+        if (run.second > 1)
+            text += ":" + to_string(run.second);
+    }
+    return text;
+}
+
+static vector<pair<uint8_t, uint32_t>> runs_from_string(const string &text)
+{
+    vector<pair<uint8_t, uint32_t>> runs;
+    stringstream ss(text);
+    string token;
+    while (ss >> token)
+    {
+        uint32_t count = 1;
+        size_t colon = token.find(':');
+        if (colon != string::npos)
+        {
+            count = stoul(token.substr(colon + 1));
+            token.resize(colon);
+        }
+
+        uint8_t stages = 0;
+        stringstream parts(token);
+        string name;
+        while (getline(parts, name, '/'))
+        {
+            int s = 0;
+            while (s < 5 && name != stage_names[s])
+                s++;
+            if (s == 5)
+                throw runtime_error("unknown pipeline stage: " + name);
+            stages |= (1 << s);
+        }
+        runs.push_back({stages, count});
+    }
+    return runs;
+}
+
+static uint64_t index_from_signed(long long value)
+{
+    return value < 0 ? SIZE_MAX : (uint64_t)value;
+}
+
+static long long index_to_signed(uint64_t index)
+{
+    return index == SIZE_MAX ? -1 : (long long)index;
+}
+
+/*                                CSV                                   */
+
+static string csv_quote(const string &text)
+{
+    string quoted = "\"";
+    for (char ch : text)
+    {
+        if (ch == '"')
+            quoted += '"';
+        quoted += ch;
+    }
+    return quoted + "\"";
+}
+
+static vector<string> csv_split(const string &line)
+{
+    vector<string> fields(1);
+    bool quoted = false;
+    for (size_t i = 0; i < line.size(); i++)
+    {
+        char ch = line[i];
+        if (quoted)
+        {
+            if (ch == '"' && i + 1 < line.size() && line[i + 1] == '"')
+                fields.back() += line[++i];
+            else if (ch == '"')
+                quoted = false;
+            else
+                fields.back() += ch;
+        }
+        else if (ch == '"')
+            quoted = true;
+        else if (ch == ',')
+            fields.emplace_back();
+        else
+            fields.back() += ch;
+    }
+    return fields;
+}
+
+static void write_csv(const sparse_diagram &d, ostream &out)
+{
+    out << "kind,a,b,c\n";
+    out << "cycles," << d.cycles << ",,\n";
+    for (size_t row = 0; row < d.rows(); row++)
+        out << "row," << row << "," << csv_quote(d.label(row)) << ",\n";
+    for (const auto &f : d.frontier)
+        out << "frontier," << f.first << "," << index_to_signed(f.second) << ",\n";
+    for (const auto &v : d.visits())
+        out << "visit," << v.row << "," << v.first_cycle << "," << runs_to_string(v.runs) << "\n";
+}
+
+static sparse_diagram read_csv(istream &in)
+{
+    sparse_diagram d;
+    vector<string> labels;
+    vector<sparse_diagram::visit> pending;
+    string line;
+    while (getline(in, line))
+    {
+        if (!line.empty() && line.back() == '\r')
+            line.pop_back();
+        vector<string> f = csv_split(line);
+        f.resize(4);
+        if (f[0] == "cycles")
+            d.cycles = stoull(f[1]);
+        else if (f[0] == "row")
+        {
+            size_t row = stoull(f[1]);
+            if (labels.size() <= row)
+                labels.resize(row + 1);
+            labels[row] = f[2];
+        }
+        else if (f[0] == "frontier")
+            d.frontier.push_back({stoull(f[1]), index_from_signed(stoll(f[2]))});
+        else if (f[0] == "visit")
+            pending.push_back({stoull(f[1]), stoull(f[2]), runs_from_string(f[3])});
+    }
+
+    uint64_t cycles = d.cycles;
+    auto frontier = d.frontier;
+    d.reset(labels);
+    d.cycles = cycles;
+    d.frontier = frontier;
+    for (const auto &v : pending)
+        d.add_visit(v);
+    return d;
+}
+
+/*                                JSON                                  */
+
+static string json_quote(const string &text)
+{
+    string quoted = "\"";
+    for (char ch : text)
+    {
+        if (ch == '"' || ch == '\\')
+            quoted += '\\';
+        quoted += ch;
+    }
+    return quoted + "\"";
+}
+
+static void write_json(const sparse_diagram &d, ostream &out)
+{
+    out << "{\"format\":\"procsim-diagram\",\"version\":1,\"cycles\":" << d.cycles << ",\n\"rows\":[";
+    for (size_t row = 0; row < d.rows(); row++)
+        out << (row ? ",\n" : "\n") << json_quote(d.label(row));
+    out << "],\n\"frontier\":[";
+    for (size_t i = 0; i < d.frontier.size(); i++)
+        out << (i ? "," : "") << "[" << d.frontier[i].first << "," << index_to_signed(d.frontier[i].second) << "]";
+    out << "],\n\"visits\":[";
+    bool first = true;
+    for (const auto &v : d.visits())
+    {
+        out << (first ? "\n" : ",\n") << "[" << v.row << "," << v.first_cycle << "," << json_quote(runs_to_string(v.runs)) << "]";
+        first = false;
+    }
+    out << "]}\n";
+}
+
+// Just enough of a JSON reader for the documents write_json() produces
+struct json_reader
+{
+    string text;
+    size_t pos = 0;
+
+    void skip()
+    {
+        while (pos < text.size() && isspace((unsigned char)text[pos]))
+            pos++;
+    }
+
+    void expect(char ch)
+    {
+        skip();
+        if (pos >= text.size() || text[pos] != ch)
+            throw runtime_error(string("malformed diagram JSON: expected '") + ch + "'");
+        pos++;
+    }
+
+    bool peek(char ch)
+    {
+        skip();
+        return pos < text.size() && text[pos] == ch;
+    }
+
+    string str()
+    {
+        expect('"');
+        string value;
+        while (pos < text.size() && text[pos] != '"')
+        {
+            if (text[pos] == '\\')
+                pos++;
+            value += text[pos++];
+        }
+        expect('"');
+        return value;
+    }
+
+    long long number()
+    {
+        skip();
+        size_t used = 0;
+        long long value = stoll(text.substr(pos, 32), &used);
+        pos += used;
+        return value;
+    }
+
+    // Calls item() for each element of an array
+    template <typename F>
+    void array(F item)
+    {
+        expect('[');
+        if (peek(']'))
+        {
+            pos++;
+            return;
+        }
+        do
+        {
+            item();
+        } while (peek(',') && ++pos);
+        expect(']');
+    }
+};
+
+static sparse_diagram read_json(istream &in)
+{
+    json_reader js;
+    js.text.assign(istreambuf_iterator<char>(in), istreambuf_iterator<char>());
+
+    sparse_diagram d;
+    uint64_t cycles = 0;
+    vector<string> labels;
+    vector<pair<uint64_t, uint64_t>> frontier;
+    vector<sparse_diagram::visit> pending;
+
+    js.expect('{');
+    do
+    {
+        string key = js.str();
+        js.expect(':');
+        if (key == "cycles")
+            cycles = js.number();
+        else if (key == "rows")
+            js.array([&]
+                     { labels.push_back(js.str()); });
+        else if (key == "frontier")
+            js.array([&]
+                     {
+                js.expect('[');
+                uint64_t cycle = js.number();
+                js.expect(',');
+                frontier.push_back({cycle, index_from_signed(js.number())});
+                js.expect(']'); });
+        else if (key == "visits")
+            js.array([&]
+                     {
+                js.expect('[');
+                size_t row = js.number();
+                js.expect(',');
+                uint64_t first = js.number();
+                js.expect(',');
+                pending.push_back({row, first, runs_from_string(js.str())});
+                js.expect(']'); });
+        else if (js.peek('"'))
+            js.str();
+        else
+            js.number();
+    } while (js.peek(',') && ++js.pos);
+    js.expect('}');
+
+    d.reset(labels);
+    d.cycles = cycles;
+    d.frontier = frontier;
+    for (const auto &v : pending)
+        d.add_visit(v);
+    return d;
+}
+
+/*                   Binary: LEB128 varints, delta coded                 */
+
+static void put_varint(ostream &out, uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        out.put((char)((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    out.put((char)value);
+}
+
+static uint64_t get_varint(istream &in)
+{
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        int byte = in.get();
+        if (byte == EOF)
+            throw runtime_error("truncated binary diagram");
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return value;
+    }
+    throw runtime_error("corrupt binary diagram");
+}
+
+static void write_binary(const sparse_diagram &d, ostream &out)
+{
+    out.write(binary_magic, sizeof(binary_magic));
+    put_varint(out, d.cycles);
+
+    put_varint(out, d.rows());
+    for (size_t row = 0; row < d.rows(); row++)
+    {
+        string label = d.label(row);
+        put_varint(out, label.size());
+        out.write(label.data(), label.size());
+    }
+
+    // SIZE_MAX + 1 wraps to 0, so "past the end" costs a single byte
+    put_varint(out, d.frontier.size());
+    uint64_t prev = 0;
+    for (const auto &f : d.frontier)
+    {
+        put_varint(out, f.first - prev);
+        put_varint(out, f.second + 1);
+        prev = f.first;
+    }
+
+    auto all = d.visits();
+    put_varint(out, all.size());
+    prev = 0;
+    for (const auto &v : all)
+    {
+        put_varint(out, v.row);
+        put_varint(out, v.first_cycle - prev);
+        put_varint(out, v.runs.size());
+        for (const auto &run : v.runs)
+        {
+            put_varint(out, run.first);
+            put_varint(out, run.second);
+        }
+        prev = v.first_cycle;
+    }
+}
+
+static sparse_diagram read_binary(istream &in)
+{
+    char magic[4];
+    in.read(magic, sizeof(magic));
+    if (!in || !equal(magic, magic + 4, binary_magic))
+        throw runtime_error("not a binary pipeline diagram");
+
+    sparse_diagram d;
+    uint64_t cycles = get_varint(in);
+
+    vector<string> labels(get_varint(in));
+    for (auto &label : labels)
+    {
+        label.resize(get_varint(in));
+        in.read(&label[0], label.size());
+    }
+    d.reset(labels);
+    d.cycles = cycles;
+
+    uint64_t count = get_varint(in), prev = 0;
+    for (uint64_t i = 0; i < count; i++)
+    {
+        prev += get_varint(in);
+        d.frontier.push_back({prev, get_varint(in) - 1});
+    }
+
+    count = get_varint(in);
+    prev = 0;
+    for (uint64_t i = 0; i < count; i++)
+    {
+        sparse_diagram::visit v;
+        v.row = get_varint(in);
+        prev += get_varint(in);
+        v.first_cycle = prev;
+        v.runs.resize(get_varint(in));
+        for (auto &run : v.runs)
+        {
+            run.first = get_varint(in);
+            run.second = get_varint(in);
+        }
+        d.add_visit(v);
+    }
+    return d;
+}
+
+/*                                                                       */
+
+void sparse_diagram::write(ostream &out, diagram_format format) const
+{
+    switch (format)
+    {
+    case diagram_format::csv:
+        write_csv(*this, out);
+        break;
+    case diagram_format::json:
+        write_json(*this, out);
+        break;
+    case diagram_format::binary:
+        write_binary(*this, out);
+        break;
+    default:
+        print_text(out);
+    }
+}
+
+sparse_diagram sparse_diagram::read(istream &in)
+{
+    int first = in.peek();
+    if (first == binary_magic[0])
+        return read_binary(in);
+    if (first == '{')
+        return read_json(in);
+    return read_csv(in);
+}
+
+void sparse_diagram::print_text(ostream &out) const
+{
+    string line;
+    for (size_t row = 0; row < rows(); row++)
+    {
+        line = label(row);
+        size_t next_cell = 0, next_frontier = 0;
+        uint64_t frontier_index = SIZE_MAX;
+        for (uint64_t cycle = 1; cycle <= cycles; cycle++)
+        {
+            while (next_frontier < frontier.size() && frontier[next_frontier].first <= cycle)
+                frontier_index = frontier[next_frontier++].second;
+
+            uint8_t stages = 0;
+            if (next_cell < cells[row].size() && cells[row][next_cell].cycle == cycle)
+                stages = cells[row][next_cell++].stages;
+
+            line += ";" + stage_text(stages, row, frontier_index);
+        }
+        out << line << "\n";
+    }
+    out << "\nTotal cycles: " << cycles << "\n";
+}
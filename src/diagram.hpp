@@ -0,0 +1,95 @@
+#ifndef DIAGRAM_HPP
+#define DIAGRAM_HPP
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// Stage bits, in the order the text diagram lists a row's stages
+enum diagram_stage : uint8_t
+{
+    STAGE_IF = 1,
+    STAGE_ID = 2,
+    STAGE_EX = 4,
+    STAGE_MEM = 8,
+    STAGE_WB = 16
+};
+
+enum class diagram_format
+{
+    text,
+    csv,
+    json,
+    binary
+};
+
+diagram_format parse_diagram_format(const string &name);
+const char *diagram_extension(diagram_format format);
+
+// Sparse pipeline diagram: only occupied (row, cycle) cells are stored, plus the
+// fetch frontier (IF/ID instruction index) whenever it changes. That is enough to
+// rebuild the padded text diagram cell for cell.
+struct sparse_diagram
+{
+    struct cell
+    {
+        uint64_t cycle; // full width: runs to completion can pass 2^32 cycles
+        uint8_t stages;
+    };
+
+    // A run of consecutive cycles one row spends in the pipeline
+    struct visit
+    {
+        size_t row;
+        uint64_t first_cycle;
+        vector<pair<uint8_t, uint32_t>> runs; // (stage bits, cycles)
+    };
+
+    uint64_t cycles = 0;
+    // Rows of a live run are labelled from their instruction words when written
+    // out; a diagram read back from a file carries its labels instead
+    vector<uint32_t> words;
+    vector<string> labels;
+    vector<vector<cell>> cells;
+    vector<pair<uint64_t, uint64_t>> frontier; // (first cycle, IF/ID instr_index)
+
+    void reset(const vector<uint32_t> &program);
+    void reset(const vector<string> &row_labels);
+
+    size_t rows() const { return cells.size(); }
+    string label(size_t row) const;
+
+    void record(uint64_t cycle, size_t row, uint8_t stages)
+    {
+        auto &row_cells = cells[row];
+        if (!row_cells.empty() && row_cells.back().cycle == cycle)
+            row_cells.back().stages |= stages;
+        else
+            row_cells.push_back({cycle, stages});
+    }
+
+    void record_frontier(uint64_t cycle, uint64_t index)
+    {
+        if (frontier.empty() || frontier.back().second != index)
+            frontier.push_back({cycle, index});
+        cycles = cycle;
+    }
+
+    // Text of one diagram cell, exactly as the text diagram prints it
+    static string stage_text(uint8_t stages, size_t row, uint64_t frontier_index);
+
+    vector<visit> visits() const;
+    void add_visit(const visit &v);
+
+    void write(ostream &out, diagram_format format) const;
+    static sparse_diagram read(istream &in);
+
+    // Rebuild the semicolon-delimited text diagram
+    void print_text(ostream &out) const;
+};
+
+#endif // DIAGRAM_HPP
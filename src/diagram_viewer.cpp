@@ -0,0 +1,40 @@
+#include "diagram.hpp"
+#include <fstream>
+#include <iostream>
+#include <string>
+
+// Converts a sparse pipeline diagram (CSV, JSON or binary) back to the text
+// diagram, or re-encodes it into another sparse format.
+int main(int argc, char* argv[]) {
+    try {
+        if (argc < 2) {
+            std::cerr << "Usage: " << argv[0] << " <diagram_file> [--to=text|csv|json|bin]" << std::endl;
+            return 1;
+        }
+
+        diagram_format format = diagram_format::text;
+        if (argc > 2) {
+            std::string option = argv[2];
+            if (option.rfind("--to=", 0) != 0) {
+                std::cerr << "Unknown option " << option << std::endl;
+                return 1;
+            }
+            format = parse_diagram_format(option.substr(5));
+        }
+
+        std::ifstream input(argv[1], std::ios::binary);
+        if (!input.is_open()) {
+            std::cerr << "Error: Could not open file " << argv[1] << std::endl;
+            return 1;
+        }
+
+        sparse_diagram diagram = sparse_diagram::read(input);
+        diagram.write(std::cout, format);
+
+    } catch (const std::exception& e) {
+        std::cerr << "Error reading diagram: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,158 @@
+#include "disassembler.hpp"
+#include "csr.hpp"
+#include <cstdio>
+
+enum operand_format : uint8_t
+{
+    OPS_INVALID,
+    OPS_R,       // rd rs1 rs2
+    OPS_I,       // rd rs1 imm (shifts: shamt)
+    OPS_LOAD,    // rd imm rs1
+    OPS_STORE,   // rs2 imm rs1
+    OPS_BRANCH,  // rs1 rs2 offset
+    OPS_U,       // rd upper immediate
+    OPS_JAL,     // rd offset
+    OPS_JALR,    // rd rs1 imm
+    OPS_SYSTEM   // ecall/ebreak, or a CSR instruction: rd csr rs1 (or zimm)
+};
+
+// One row per major opcode (bits 6:2), names by funct3; alt holds the
+// funct7 = 0x20 forms (sub, sra, srai)
+struct opcode_entry
+{
+    operand_format format;
+    const char *names[8];
+    const char *alt[8];
+};
+
+static const opcode_entry opcode_table[32] = {
+    /* 0x03 */ {OPS_LOAD, {"lb", "lh", "lw", "ld", "lbu", "lhu", "lwu"}, {}},
+    /* 0x07 */ {},
+    /* 0x0B */ {},
+    /* 0x0F */ {},
+    /* 0x13 */ {OPS_I, {"addi", "slli", "slti", "sltiu", "xori", "srli", "ori", "andi"}, {nullptr, nullptr, nullptr, nullptr, nullptr, "srai"}},
+    /* 0x17 */ {OPS_U, {"auipc", "auipc", "auipc", "auipc", "auipc", "auipc", "auipc", "auipc"}, {}},
+    /* 0x1B */ {},
+    /* 0x1F */ {},
+    /* 0x23 */ {OPS_STORE, {"sb", "sh", "sw", "sd"}, {}},
+    /* 0x27 */ {},
+    /* 0x2B */ {},
+    /* 0x2F */ {},
+    /* 0x33 */ {OPS_R, {"add", "sll", "slt", "sltu", "xor", "srl", "or", "and"}, {"sub", nullptr, nullptr, nullptr, nullptr, "sra"}},
+    /* 0x37 */ {OPS_U, {"lui", "lui", "lui", "lui", "lui", "lui", "lui", "lui"}, {}},
+    /* 0x3B */ {},
+    /* 0x3F */ {},
+    /* 0x43 */ {},
+    /* 0x47 */ {},
+    /* 0x4B */ {},
+    /* 0x4F */ {},
+    /* 0x53 */ {},
+    /* 0x57 */ {},
+    /* 0x5B */ {},
+    /* 0x5F */ {},
+    /* 0x63 */ {OPS_BRANCH, {"beq", "bne", nullptr, nullptr, "blt", "bge", "bltu", "bgeu"}, {}},
+    /* 0x67 */ {OPS_JALR, {"jalr"}, {}},
+    /* 0x6B */ {},
+    /* 0x6F */ {OPS_JAL, {"jal", "jal", "jal", "jal", "jal", "jal", "jal", "jal"}, {}},
+    /* 0x73 */ {OPS_SYSTEM, {"ecall", "csrrw", "csrrs", "csrrc", nullptr, "csrrwi", "csrrsi", "csrrci"}, {}},
+    /* 0x77 */ {},
+    /* 0x7B */ {},
+    /* 0x7F */ {},
+};
+
+// The names the assembler accepts, or the number in hex
+static string csr_name(uint32_t csr)
+{
+    switch (csr)
+    {
+    case CSR_CYCLE:
+        return "cycle";
+    case CSR_TIME:
+        return "time";
+    case CSR_INSTRET:
+        return "instret";
+    case CSR_ROI:
+        return "roi";
+    }
+    char hex[8];
+    snprintf(hex, sizeof(hex), "0x%03x", csr);
+    return hex;
+}
+
+string disassemble(uint32_t instruction)
+{
+    uint32_t rd = (instruction >> 7) & 0x1F;
+    uint32_t funct3 = (instruction >> 12) & 0x7;
+    uint32_t rs1 = (instruction >> 15) & 0x1F;
+    uint32_t rs2 = (instruction >> 20) & 0x1F;
+    int32_t imm_i = (int32_t)instruction >> 20;
+
+    const opcode_entry &entry = opcode_table[(instruction >> 2) & 0x1F];
+    bool alt = ((instruction >> 30) & 1) && entry.alt[funct3];
+    const char *name = alt ? entry.alt[funct3] : entry.names[funct3];
+    // Bits that must be clear for the forms above
+    bool shift = entry.format == OPS_I && (funct3 == 1 || funct3 == 5);
+    bool bad = (instruction & 3) != 3 || !name ||
+               (entry.format == OPS_R && (instruction >> 25) != (alt ? 0x20u : 0u)) ||
+               (shift && (instruction >> 26) != (alt ? 0x10u : 0u)) ||
+               (entry.format == OPS_SYSTEM && funct3 == 0 && (instruction & ~0x100000u) != 0x73);
+
+    char text[48];
+    if (bad)
+    {
+        snprintf(text, sizeof(text), ".word 0x%08x", instruction);
+        return text;
+    }
+
+    switch (entry.format)
+    {
+    case OPS_R:
+        snprintf(text, sizeof(text), "%s x%u x%u x%u", name, rd, rs1, rs2);
+        break;
+    case OPS_I:
+        snprintf(text, sizeof(text), "%s x%u x%u %d", name, rd, rs1, shift ? (int32_t)((instruction >> 20) & 0x3F) : imm_i);
+        break;
+    case OPS_LOAD:
+        snprintf(text, sizeof(text), "%s x%u %d x%u", name, rd, imm_i, rs1);
+        break;
+    case OPS_STORE:
+        snprintf(text, sizeof(text), "%s x%u %d x%u", name, rs2, ((int32_t)(instruction & 0xFE000000) >> 20) | (int32_t)rd, rs1);
+        break;
+    case OPS_BRANCH:
+    {
+        int32_t offset = ((int32_t)(instruction & 0x80000000) >> 19) | ((instruction & 0x80) << 4) |
+                         ((instruction >> 20) & 0x7E0) | ((instruction >> 7) & 0x1E);
+        snprintf(text, sizeof(text), "%s x%u x%u %d", name, rs1, rs2, offset);
+        break;
+    }
+    case OPS_U:
+        snprintf(text, sizeof(text), "%s x%u 0x%x", name, rd, instruction >> 12);
+        break;
+    case OPS_JAL:
+    {
+        int32_t offset = ((int32_t)(instruction & 0x80000000) >> 11) | (instruction & 0xFF000) |
+                         ((instruction >> 9) & 0x800) | ((instruction >> 20) & 0x7FE);
+        snprintf(text, sizeof(text), "%s x%u %d", name, rd, offset);
+        break;
+    }
+    case OPS_JALR:
+        snprintf(text, sizeof(text), "%s x%u x%u %d", name, rd, rs1, imm_i);
+        break;
+    case OPS_SYSTEM:
+        if (funct3 == 0)
+            return instruction == 0x73 ? "ecall" : "ebreak";
+        snprintf(text, sizeof(text), (funct3 & 0x4) ? "%s x%u %s %u" : "%s x%u %s x%u", name, rd,
+                 csr_name(csr_number(instruction)).c_str(), rs1);
+        break;
+    default:
+        snprintf(text, sizeof(text), ".word 0x%08x", instruction);
+    }
+    return text;
+}
+
+string instruction_label(uint32_t instruction)
+{
+    char hex[16];
+    snprintf(hex, sizeof(hex), "%08x ", instruction);
+    return hex + disassemble(instruction);
+}
@@ -0,0 +1,18 @@
+#ifndef DISASSEMBLER_HPP
+#define DISASSEMBLER_HPP
+
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+// Assembly text for an instruction word, written the way the input listings
+// are and the assembler reads it back: x register names, "lw rd imm rs1" and
+// "sw rs2 imm rs1", branch and jump targets as byte offsets. Words outside
+// the base integer and Zicsr sets come out as ".word 0x...".
+string disassemble(uint32_t instruction);
+
+// Diagram and profile row label: "hex disassembly", the shape of a listing line
+string instruction_label(uint32_t instruction);
+
+#endif // DISASSEMBLER_HPP
@@ -4,11 +4,28 @@
 #include <iostream>
 #include <vector>
 #include <map>
+#include <set>
 #include <cstdint>
+#include <stdexcept>
+#include "mmio.hpp"
 
 typedef long long ll;
 using namespace std;
 
+// One location's share of an incremental state hash: XOR it out for the old
+// value and in for the new one on every write. Zero contributes nothing, so a
+// location never written and one holding 0 hash alike.
+static inline uint64_t state_mix(uint64_t location, int64_t value)
+{
+    if (value == 0)
+        return 0;
+    uint64_t h = ((location + 1) * 0x9E3779B97F4A7C15ull) ^ (uint64_t)value;
+    h ^= h >> 31;
+    h *= 0xD6E8FEB86659FD93ull;
+    h ^= h >> 32;
+    return h;
+}
+
 struct program_counter
 {
     uint64_t instruction_address = 0;
@@ -23,8 +40,7 @@ struct instruction_memory
     {
         if (address / 4 >= instructions.size())
         {
-            cerr << "Invalid instruction address!\n";
-            exit(1);
+            throw out_of_range("Invalid instruction address!");
         }
         else
         {
@@ -52,11 +68,16 @@ struct PC_handler
     PC_handler() {}
 };
 
+// Pipeline registers and control signals are read and written every cycle.
+// Wide fields come first and the one-bit signals share a byte, so the four
+// latches fit in about two cache lines. Bitfields cannot have default member
+// initializers before C++20, so the constructors clear them.
+
 struct IF_ID_register_file
 {
-    uint32_t instruction = 0;
     uint64_t program_counter = 0;
     uint64_t instr_index = -1;
+    uint32_t instruction = 0;
 
     bool flush = false;
 
@@ -67,20 +88,51 @@ struct IF_ID_register_file
 struct ControlSignals
 {
     // WB control signals
-    bool regWrite = false;
-    bool memToReg = false;
+    bool regWrite : 1;
+    bool memToReg : 1;
 
     // MEM control signals
-    bool memRead = false;
-    bool memWrite = false;
-    bool branch = false;
+    bool memRead : 1;
+    bool memWrite : 1;
+    bool branch : 1;
 
     // EX control signals
-    bool aluSrc = false;
-    uint8_t aluOp = 0;
+    bool aluSrc : 1;
+    uint8_t aluOp : 2;
 
     // Constructor
-    ControlSignals() {}
+    ControlSignals() : regWrite(false), memToReg(false), memRead(false), memWrite(false),
+                       branch(false), aluSrc(false), aluOp(0) {}
+};
+
+// Register dependences as bitmasks, one bit per architectural register. x0
+// never gets a bit, so "rd != 0 && (rd == rs1 || rd == rs2)" is a single AND
+// of a destination mask against a source mask.
+inline uint32_t reg_bit(uint8_t reg)
+{
+    return (1u << (reg & 0x1F)) & ~1u;
+}
+
+inline uint32_t source_mask(uint8_t rs1, uint8_t rs2)
+{
+    return reg_bit(rs1) | reg_bit(rs2);
+}
+
+inline uint32_t dest_mask(uint8_t rd, bool writes)
+{
+    return writes ? reg_bit(rd) : 0;
+}
+
+// Ready bits for the hazard units, one per register as in reg_bit(): a set bit
+// means the newest value of that register cannot be read in ID yet. Rebuilt
+// from the pipeline latches each cycle (Processor::update_scoreboard).
+struct register_scoreboard
+{
+    uint32_t busy = 0;    // written by the instruction in EX or MEM
+    uint32_t loading = 0; // loaded by the instruction in EX, late even with forwarding
+    uint32_t writing = 0; // written back this cycle
+
+    bool ready(uint8_t reg) const { return !(busy & reg_bit(reg)); }
 };
 
 struct Forward_HazardDetectionUnit
@@ -93,9 +145,7 @@ struct Forward_HazardDetectionUnit
     bool branch_taken = false;
 
     // Enhanced detection for load-branch hazards
-    void detect(uint8_t id_ex_rd, uint8_t ex_mem_rd, uint8_t if_id_rs1,
-                uint8_t if_id_rs2, bool id_ex_memRead, bool ex_mem_memRead,
-                bool id_ex_regWrite, bool ex_mem_regWrite, bool mem_wb_regwrite, uint8_t mem_wb_rd)
+    void detect(const register_scoreboard &scoreboard, uint8_t if_id_rs1, uint8_t if_id_rs2)
     {
 
         uint32_t opcode = if_id_ins & 0x7F;
@@ -103,16 +153,13 @@ struct Forward_HazardDetectionUnit
 
         stall = flush = branch_taken = false;
 
-        // Load-use hazard (including load-branch hazard)
-        stall = (id_ex_memRead && ((id_ex_rd == if_id_rs1 || id_ex_rd == if_id_rs2) && id_ex_rd != 0));
+        uint32_t sources = source_mask(if_id_rs1, if_id_rs2);
 
-        bool hazard_id_ex = ((is_branch) && (id_ex_rd != 0) && (id_ex_regWrite || id_ex_memRead) &&
-                             (id_ex_rd == if_id_rs1 || id_ex_rd == if_id_rs2));
-
-        bool hazard_ex_mem = ((is_branch) && (ex_mem_rd != 0) && (ex_mem_regWrite || ex_mem_memRead) &&
-                              (ex_mem_rd == if_id_rs1 || ex_mem_rd == if_id_rs2));
+        // Load-use hazard (including load-branch hazard)
+        stall = (sources & scoreboard.loading) != 0;
 
-        stall = stall || hazard_ex_mem || hazard_id_ex;
+        // Branches resolve in ID, so they also wait for ALU results still in EX or MEM
+        stall = stall || (is_branch && (sources & scoreboard.busy));
 
         opcode = instruction & 0x7F;
         is_branch = (opcode == 0x63);
@@ -122,7 +169,7 @@ struct Forward_HazardDetectionUnit
         else if (is_branch)
         {
             uint32_t func3 = (instruction >> 12) & 0x7;
-            bool hazard_mem_wb = (mem_wb_rd != 0) and (mem_wb_regwrite) and (mem_wb_rd == if_id_rs1 || mem_wb_rd == if_id_rs2);
+            bool hazard_mem_wb = (sources & scoreboard.writing) != 0;
 
             if (((func3 == 0x0 && is_equal) || (func3 == 0x1 && !is_equal)) and !hazard_mem_wb)
             {
@@ -142,25 +189,17 @@ struct HazardDetectionUnit
     bool branch_taken = false;
 
     // For no-forwarding processor - detect all RAW hazards
-    void detect(uint8_t id_ex_rd, uint8_t ex_mem_rd, uint8_t if_id_rs1,
-                uint8_t if_id_rs2, bool id_ex_memRead, bool ex_mem_memRead,
-                bool id_ex_regWrite, bool ex_mem_regWrite, bool mem_wb_regwrite, uint8_t mem_wb_rd)
+    void detect(const register_scoreboard &scoreboard, uint8_t if_id_rs1, uint8_t if_id_rs2)
     {
 
         stall = false;
         flush = false;
         branch_taken = false;
 
-        // Any instruction in ID stage depends on result from previous instructions
-        bool hazard_id_ex = (id_ex_rd != 0) && (id_ex_regWrite || id_ex_memRead) &&
-                            (id_ex_rd == if_id_rs1 || id_ex_rd == if_id_rs2);
+        uint32_t sources = source_mask(if_id_rs1, if_id_rs2);
 
-        bool hazard_ex_mem = (ex_mem_rd != 0) && (ex_mem_regWrite || ex_mem_memRead) &&
-                             (ex_mem_rd == if_id_rs1 || ex_mem_rd == if_id_rs2);
-
-        // bool hazard_mem_wb = (mem_wb_rd != 0) and (mem_wb_regwrite) and (mem_wb_rd == if_id_rs1 || mem_wb_rd == if_id_rs2);
-
-        stall = hazard_id_ex || hazard_ex_mem; // || hazard_mem_wb;
+        // Any instruction in ID stage depends on result from previous instructions
+        stall = (sources & scoreboard.busy) != 0;
 
         uint32_t opcode = instruction & 0x7F;
         bool is_branch = (opcode == 0x63);
@@ -172,7 +211,7 @@ struct HazardDetectionUnit
         else if (is_branch)
         {
             uint32_t func3 = (instruction >> 12) & 0x7;
-            bool hazard_mem_wb = (mem_wb_rd != 0) and (mem_wb_regwrite) and (mem_wb_rd == if_id_rs1 || mem_wb_rd == if_id_rs2);
+            bool hazard_mem_wb = (sources & scoreboard.writing) != 0;
 
             if (((func3 == 0x0 && is_equal) || (func3 == 0x1 && !is_equal)) and !hazard_mem_wb)
             {
@@ -187,7 +226,7 @@ struct HazardDetectionUnit
         }
         else if (is_jalr)
         {
-            bool hazard_mem_wb = (mem_wb_rd != 0) and (mem_wb_regwrite) and (mem_wb_rd == if_id_rs1 || mem_wb_rd == if_id_rs2);
+            bool hazard_mem_wb = (sources & scoreboard.writing) != 0;
             if (!hazard_mem_wb)
             {
                 flush = true;
@@ -197,45 +236,95 @@ struct HazardDetectionUnit
     }
 };
 
-struct register_memory
+// Register file with READS read and WRITES write ports. The pipeline uses
+// 2R1W; a wide-issue core would instantiate register_file<4, 2>. Ports hold
+// the 5-bit architectural index, so a read is a single array load, and x0
+// reads zero because no write ever lands on it. Write ports apply in index
+// order, so the higher port wins when two write the same register.
+template <unsigned READS, unsigned WRITES>
+struct register_file
 {
-    // Inputs
-    uint8_t r1 = 0;
-    uint8_t r2 = 0;
-    uint8_t rd = 0;
-    int64_t w_data = 0;
+    struct read_port
+    {
+        uint8_t reg = 0;
+        int64_t data = 0;
+    };
+
+    struct write_port
+    {
+        bool enable = false;
+        uint8_t reg = 0;
+        int64_t data = 0;
+    };
 
-    // Control signals
-    bool regWrite = false;
-    bool branch_eq = false;
+    read_port read_ports[READS];
+    write_port write_ports[WRITES];
 
     // Register memory
     int64_t registers[32] = {0};
+    // Kept up to date by write() (see state_mix)
+    uint64_t state_hash = 0;
+
+    register_scoreboard scoreboard;
+
+    // Port activity for the energy estimate: reads of x0 cost nothing and are not counted
+    uint64_t reads = 0;
+    uint64_t writes = 0;
+
+    // Watchpoints: one bit per register, so an unwatched write costs a single test
+    uint32_t watch_mask = 0;
+    bool watch_hit = false;
+    uint8_t watch_reg = 0;
 
-    // Outputs
-    int64_t r_data1 = 0;
-    int64_t r_data2 = 0;
+    void set_read(unsigned port, uint8_t reg) { read_ports[port].reg = reg & 0x1F; }
+    void set_write(unsigned port, bool enable, uint8_t reg, int64_t data)
+    {
+        write_ports[port].enable = enable && (reg & 0x1F) != 0;
+        write_ports[port].reg = reg & 0x1F;
+        write_ports[port].data = data;
+    }
+    int64_t data(unsigned port) const { return read_ports[port].data; }
+
+    void read()
+    {
+        for (read_port &port : read_ports)
+        {
+            port.data = registers[port.reg];
+            reads += port.reg != 0;
+        }
+    }
 
     void write()
     {
-        if (regWrite)
+        for (const write_port &port : write_ports)
         {
-            if (rd != 0)
-            { // x0 shouldn't be changed
-                registers[rd] = w_data;
+            if (!port.enable)
+                continue;
+            writes++;
+            state_hash ^= state_mix(port.reg, registers[port.reg]) ^ state_mix(port.reg, port.data);
+            registers[port.reg] = port.data;
+            if (watch_mask & (1u << port.reg))
+            {
+                watch_hit = true;
+                watch_reg = port.reg;
             }
         }
     }
-    void produce_read()
+
+    // Result being written back this same cycle, for reads issued before the
+    // write lands
+    void bypass(bool enable, uint8_t reg, int64_t value)
     {
-        r1 = (r1 & 1) + (r1 & 2) * 2 + (r1 & 4) * 4 + (r1 & 8) * 8 + (r1 & 16) * 16;
-        r2 = (r2 & 1) + (r2 & 2) * 2 + (r2 & 4) * 4 + (r2 & 8) * 8 + (r2 & 16) * 16;
-        r_data1 = (r1 < 32) ? registers[r1] : 0;
-        r_data2 = (r2 < 32) ? registers[r2] : 0;
-        branch_eq = (r_data1 == r_data2);
+        if (!enable || reg == 0)
+            return;
+        for (read_port &port : read_ports)
+            if (port.reg == reg)
+                port.data = value;
     }
 };
 
+using register_memory = register_file<2, 1>;
+
 struct imm_gen
 {
     uint32_t instruction = 0;
@@ -305,32 +394,33 @@ struct imm_gen
 
 struct ID_EX_register_file
 {
-    // WB control signals
-    bool regWrite = false;
-    bool memToReg = false;
-
-    // MEM control signals
-    bool memRead = false;
-    bool memWrite = false;
-
-    // EX control signals
-    bool aluSrc = false;
-    uint8_t aluOp = 0;
-
     int64_t reg1_data = 0;
     int64_t reg2_data = 0;
     int64_t tempr1_data = 0;
     int64_t immediate = 0;
 
+    uint64_t instr_index = SIZE_MAX;
+    uint32_t instruction = 0;
+
     uint8_t IF_ID_Register_RS1 = 0;
     uint8_t IF_ID_Register_RS2 = 0;
     uint8_t IF_ID_Register_RD = 0;
 
-    uint32_t instruction = 0;
-    uint64_t instr_index = SIZE_MAX;
+    // WB control signals
+    bool regWrite : 1;
+    bool memToReg : 1;
 
-    // Constructor - all members already have initializers
-    ID_EX_register_file() {}
+    // MEM control signals
+    bool memRead : 1;
+    bool memWrite : 1;
+
+    // EX control signals
+    bool aluSrc : 1;
+    uint8_t aluOp : 2;
+
+    // Constructor
+    ID_EX_register_file() : regWrite(false), memToReg(false), memRead(false), memWrite(false),
+                            aluSrc(false), aluOp(0) {}
 };
 
 struct MUX_ALU
@@ -412,25 +502,15 @@ struct ForwardingUnit
     void detect(bool ex_mem_regWrite, uint32_t ex_mem_rd, bool mem_wb_regWrite,
                 uint32_t mem_wb_rd, uint32_t id_ex_rs1, uint32_t id_ex_rs2)
     {
-        // Forward from EX/MEM
-        if (ex_mem_regWrite && ex_mem_rd != 0)
-        {
-            if (ex_mem_rd == id_ex_rs1)
-                forwardA = 2;
-
-            if (ex_mem_rd == id_ex_rs2)
-                forwardB = 2;
-        }
-
-        // Forward from MEM/WB
-        if (mem_wb_regWrite && mem_wb_rd != 0)
-        {
-            if (forwardA != 2 and mem_wb_rd == id_ex_rs1)
-                forwardA = 1;
-
-            if (forwardB != 2 and mem_wb_rd == id_ex_rs2)
-                forwardB = 1;
-        }
+        // EX/MEM (2) takes priority over MEM/WB (1)
+        uint32_t ex_mem = dest_mask(ex_mem_rd, ex_mem_regWrite);
+        uint32_t mem_wb = dest_mask(mem_wb_rd, mem_wb_regWrite);
+        uint32_t a = reg_bit(id_ex_rs1);
+        uint32_t b = reg_bit(id_ex_rs2);
+
+        // Every select is written, so the unit is reused across cycles without a reset
+        forwardA = (a & ex_mem) ? 2 : (a & mem_wb) ? 1 : 0;
+        forwardB = (b & ex_mem) ? 2 : (b & mem_wb) ? 1 : 0;
         generate_output();
     }
 
@@ -466,23 +546,22 @@ struct ForwardingUnit
 
 struct EX_MEM_register_file
 {
-    // WB control signals
-    bool regWrite = false;
-    bool memToReg = false;
-
-    // MEM control signals
-    bool memRead = false;
-    bool memWrite = false;
-    // bool branch   = false;
-
     int64_t alu_result = 0;
     int64_t write_data = 0;
+    uint64_t instr_index = SIZE_MAX;
     uint8_t ID_EX_RegisterRD = 0;
 
-    uint64_t instr_index = SIZE_MAX;
+    // WB control signals
+    bool regWrite : 1;
+    bool memToReg : 1;
+
+    // MEM control signals
+    bool memRead : 1;
+    bool memWrite : 1;
+    // bool branch   = false;
 
     // bool zero = false;
-    EX_MEM_register_file() {}
+    EX_MEM_register_file() : regWrite(false), memToReg(false), memRead(false), memWrite(false) {}
 };
 
 struct data_memory
@@ -497,42 +576,391 @@ struct data_memory
 
     // Memory
     map<uint64_t, int64_t> data_memory;
+    // Kept up to date by write() (see state_mix)
+    uint64_t state_hash = 0;
 
     // Output
     int64_t r_data = 0;
 
     uint64_t wb_index = 0;
 
+    // Device registers above mmio_base; nullptr leaves that range unmapped
+    mmio_bus *mmio = nullptr;
+
+    // Trace replay: accesses are timed but nothing is stored and loads read 0
+    bool timing_only = false;
+
+    // Watchpoints: a hashed bitmap filters writes, the exact set is only searched on a filter hit
+    uint64_t watch_filter[64] = {0};
+    set<uint64_t> watch_addrs;
+    bool watch_hit = false;
+    uint64_t watch_addr = 0;
+
+    static uint32_t watch_slot(uint64_t address)
+    {
+        return (address ^ (address >> 12)) & 0xFFF;
+    }
+
+    void add_watch(uint64_t address)
+    {
+        watch_addrs.insert(address);
+        uint32_t slot = watch_slot(address);
+        watch_filter[slot >> 6] |= 1ull << (slot & 63);
+    }
+
+    void remove_watch(uint64_t address)
+    {
+        watch_addrs.erase(address);
+        // Rebuild the filter so stale bits do not keep forcing set lookups
+        for (auto &word : watch_filter)
+            word = 0;
+        for (uint64_t a : watch_addrs)
+        {
+            uint32_t slot = watch_slot(a);
+            watch_filter[slot >> 6] |= 1ull << (slot & 63);
+        }
+    }
+
     void read()
     {
         if (memRead)
         {
-            r_data = data_memory[addr];
+            if (timing_only)
+                r_data = 0;
+            else if (addr >= mmio_base)
+                r_data = mmio ? mmio->read(addr) : 0;
+            else
+                r_data = data_memory[addr];
         }
     }
     void write()
     {
-        if (memWrite)
+        if (memWrite && !timing_only)
         {
-            data_memory[addr] = w_data;
+            if (addr >= mmio_base)
+            {
+                if (mmio)
+                    mmio->write(addr, w_data);
+                return;
+            }
+            int64_t &cell = data_memory[addr];
+            state_hash ^= state_mix(addr, cell) ^ state_mix(addr, w_data);
+            cell = w_data;
+            uint32_t slot = watch_slot(addr);
+            if ((watch_filter[slot >> 6] >> (slot & 63)) & 1)
+            {
+                if (watch_addrs.count(addr))
+                {
+                    watch_hit = true;
+                    watch_addr = addr;
+                }
+            }
         }
     }
 };
 
-struct MEM_WB_register_file
+// Store buffer between MEM and data memory. Stores retire into a fixed ring of
+// write-combining entries, one per 32-byte line, and drain to memory in order,
+// one entry every drain_interval cycles. Loads check the buffer first. With no
+// entries configured every store goes straight to memory, as before.
+struct store_buffer
 {
-    // WB control signals
-    bool regWrite = false;
-    bool memToReg = false;
+    static const uint64_t line_bytes = 32;
 
+    struct entry
+    {
+        uint64_t line = 0;
+        uint32_t valid = 0; // one bit per byte offset holding a pending store
+        int64_t values[line_bytes];
+    };
+
+    struct counters
+    {
+        uint64_t stores = 0;
+        uint64_t coalesced = 0;       // stores merged into an entry already pending
+        uint64_t forwarded_loads = 0; // loads satisfied from the buffer
+        uint64_t full_stalls = 0;     // cycles a store waited for a free entry
+        uint64_t drained = 0;         // entries written back to memory
+        uint64_t occupancy_sum = 0;   // entries in use, summed per cycle
+        uint64_t max_occupancy = 0;
+        uint64_t cycles = 0;
+    };
+
+    vector<entry> ring; // sized once by configure()
+    size_t head = 0;
+    size_t count = 0;
+    uint32_t drain_interval = 1;
+    uint32_t drain_timer = 0;
+    counters stats;
+
+    void configure(size_t entries, uint32_t interval)
+    {
+        ring.assign(entries, entry());
+        head = count = 0;
+        drain_interval = max<uint32_t>(interval, 1);
+        drain_timer = 0;
+        stats = counters();
+    }
+
+    bool enabled() const { return !ring.empty(); }
+    bool empty() const { return count == 0; }
+
+    static bool buffered(uint64_t address) { return address < mmio_base; }
+
+    // Each line has at most one pending entry, since later stores coalesce into it
+    const entry *find(uint64_t line) const
+    {
+        for (size_t i = 0; i < count; i++)
+        {
+            const entry &e = ring[(head + i) % ring.size()];
+            if (e.line == line)
+                return &e;
+        }
+        return nullptr;
+    }
+
+    entry *find(uint64_t line)
+    {
+        return const_cast<entry *>(static_cast<const store_buffer *>(this)->find(line));
+    }
+
+    // Would a store to this address complete this cycle?
+    bool accepts(uint64_t address)
+    {
+        return !buffered(address) || count < ring.size() || find(address & ~(line_bytes - 1));
+    }
+
+    void push(uint64_t address, int64_t value)
+    {
+        uint64_t line = address & ~(line_bytes - 1);
+        uint32_t offset = address & (line_bytes - 1);
+        stats.stores++;
+
+        entry *e = find(line);
+        if (e)
+        {
+            stats.coalesced++;
+        }
+        else
+        {
+            e = &ring[(head + count) % ring.size()];
+            e->line = line;
+            e->valid = 0;
+            count++;
+        }
+        e->values[offset] = value;
+        e->valid |= 1u << offset;
+    }
+
+    // Pending value for this address, if any
+    bool peek(uint64_t address, int64_t &value) const
+    {
+        const entry *e = find(address & ~(line_bytes - 1));
+        uint32_t offset = address & (line_bytes - 1);
+        if (!e || !((e->valid >> offset) & 1))
+            return false;
+        value = e->values[offset];
+        return true;
+    }
+
+    // Store-to-load forwarding for a load in MEM
+    bool forward(uint64_t address, int64_t &value)
+    {
+        if (!peek(address, value))
+            return false;
+        stats.forwarded_loads++;
+        return true;
+    }
+
+    // Once per cycle: account occupancy, then drain the oldest entry when due
+    void tick(data_memory &memory)
+    {
+        stats.cycles++;
+        stats.occupancy_sum += count;
+        stats.max_occupancy = max<uint64_t>(stats.max_occupancy, count);
+
+        if (count == 0 || ++drain_timer < drain_interval)
+            return;
+        drain_timer = 0;
+
+        entry &e = ring[head];
+        for (uint32_t bits = e.valid; bits; bits &= bits - 1)
+        {
+            uint32_t offset = __builtin_ctz(bits);
+            memory.addr = e.line + offset;
+            memory.w_data = e.values[offset];
+            memory.memWrite = true;
+            memory.write();
+        }
+        memory.memWrite = false;
+        head = (head + 1) % ring.size();
+        count--;
+        stats.drained++;
+    }
+};
+
+// Store-set memory-dependence predictor (Chrysos and Emer) run over the
+// committed stream. The in-order pipeline never lets a load pass an older
+// store, so this evaluates speculative load hoisting instead: each load is
+// taken to issue ahead of the stores among the previous window instructions
+// unless the predictor puts it in the same store set as one of them, in which
+// case it waits for the youngest such store. Addresses disambiguate: a load
+// that went ahead of a store to the same address is a violation and is
+// replayed, and one that waited only for stores to other addresses is a false
+// dependence. Violations train the predictor by merging the two store sets.
+struct store_set_predictor
+{
+    static const size_t table_size = 4096;         // store set id table, indexed by pc
+    static const uint64_t clear_interval = 1 << 20; // memory ops between table clears
+    static constexpr uint32_t no_set = UINT32_MAX;
+
+    struct store
+    {
+        uint64_t sequence;
+        uint64_t pc;
+        uint64_t address;
+        uint32_t set;
+    };
+
+    struct counters
+    {
+        uint64_t loads = 0;
+        uint64_t stores = 0;
+        uint64_t exposed_loads = 0;         // loads with an older store inside the window
+        uint64_t hoisted = 0;               // went ahead of every such store, correctly
+        uint64_t synchronized = 0;          // waited for a store to the same address
+        uint64_t false_dependences = 0;     // waited, but only for other addresses
+        uint64_t violations = 0;            // went ahead of a store to the same address
+        uint64_t replays = 0;               // loads re-executed after a violation
+        uint64_t replayed_instructions = 0; // the load and everything it had passed, per replay
+    };
+
+    size_t window = 0; // 0 = off
+    vector<uint32_t> set_ids;
+    vector<store> recent; // ring of the stores in the window, sized once by configure()
+    size_t head = 0;
+    size_t count = 0;
+    uint64_t sequence = 0;
+    uint64_t accesses = 0;
+    uint32_t next_set = 0;
+    counters stats;
+
+    void configure(size_t instructions)
+    {
+        window = instructions;
+        set_ids.assign(window ? table_size : 0, no_set);
+        recent.assign(window, store());
+        head = count = 0;
+        sequence = accesses = 0;
+        next_set = 0;
+        stats = counters();
+    }
+
+    bool enabled() const { return window != 0; }
+
+    static size_t slot(uint64_t pc) { return (pc >> 2) % table_size; }
+
+    // Every committed instruction, in order; address is the effective address of loads and stores
+    void retire(uint64_t pc, uint32_t instruction, uint64_t address)
+    {
+        sequence++;
+        uint32_t opcode = instruction & 0x7F;
+        if ((opcode != 0x03 && opcode != 0x23) || address >= mmio_base)
+            return;
+        if (++accesses % clear_interval == 0)
+            fill(set_ids.begin(), set_ids.end(), no_set);
+
+        // Forget stores that have left the window
+        while (count && recent[head].sequence + window <= sequence)
+        {
+            head = (head + 1) % window;
+            count--;
+        }
+
+        if (opcode == 0x23)
+        {
+            stats.stores++;
+            if (count == window)
+            {
+                head = (head + 1) % window;
+                count--;
+            }
+            recent[(head + count) % window] = {sequence, pc, address, set_ids[slot(pc)]};
+            count++;
+            return;
+        }
+
+        stats.loads++;
+        if (!count)
+            return;
+        stats.exposed_loads++;
+
+        // Youngest store the load waits for, and youngest store it must not pass
+        uint32_t set = set_ids[slot(pc)];
+        const store *wait = nullptr, *alias = nullptr;
+        for (size_t i = count; i-- > 0 && !(wait && alias);)
+        {
+            const store &s = recent[(head + i) % window];
+            if (!wait && set != no_set && s.set == set)
+                wait = &s;
+            if (!alias && s.address == address)
+                alias = &s;
+        }
+
+        if (alias && (!wait || alias->sequence > wait->sequence))
+        {
+            stats.violations++;
+            stats.replays++;
+            stats.replayed_instructions += sequence - alias->sequence;
+            merge(pc, alias->pc);
+        }
+        else if (alias)
+            stats.synchronized++;
+        else if (wait)
+            stats.false_dependences++;
+        else
+            stats.hoisted++;
+    }
+
+    // Put a load and the store it violated in one store set
+    void merge(uint64_t load_pc, uint64_t store_pc)
+    {
+        uint32_t &load_set = set_ids[slot(load_pc)];
+        uint32_t &store_set = set_ids[slot(store_pc)];
+        if (load_set == no_set && store_set == no_set)
+            load_set = store_set = next_set++;
+        else if (load_set == no_set)
+            load_set = store_set;
+        else if (store_set == no_set)
+            store_set = load_set;
+        else
+            load_set = store_set = min(load_set, store_set);
+    }
+};
+
+struct MEM_WB_register_file
+{
     int64_t alu_result = 0;
     int64_t read_data = 0;
+    uint64_t instr_index = SIZE_MAX;
     uint8_t EX_MEM_RegisterRD = 0;
 
-    uint64_t instr_index = SIZE_MAX;
+    // WB control signals
+    bool regWrite : 1;
+    bool memToReg : 1;
 
     // Constructor
-    MEM_WB_register_file() {}
+    MEM_WB_register_file() : regWrite(false), memToReg(false) {}
+};
+
+// The values the pipeline registers take at the next clock edge. Stages read
+// the current registers and write only here, so they can run in any order.
+struct pipeline_latches
+{
+    IF_ID_register_file IF_ID;
+    ID_EX_register_file ID_EX;
+    EX_MEM_register_file EX_MEM;
+    MEM_WB_register_file MEM_WB;
 };
 
 struct MUX_WB
@@ -549,4 +977,45 @@ struct MUX_WB
     MUX_WB() {}
 };
 
+// Brent's cycle finding over a stream of machine-state hashes. A deterministic
+// machine that reaches the same state twice will loop forever, whatever the
+// period. The saved state is replaced at power-of-two distances, so a loop is
+// reported within about twice its start plus period observations, in O(1) space.
+struct loop_detector
+{
+    uint64_t saved = 0;
+    uint64_t saved_cycle = 0;
+    uint64_t power = 1;
+    uint64_t distance = 0;
+    bool started = false;
+
+    // Cycles between the two matching states once observe() has returned true
+    uint64_t period = 0;
+
+    bool observe(uint64_t hash, uint64_t cycle)
+    {
+        if (!started)
+        {
+            saved = hash;
+            saved_cycle = cycle;
+            started = true;
+            return false;
+        }
+        distance++;
+        if (hash == saved)
+        {
+            period = cycle - saved_cycle;
+            return true;
+        }
+        if (distance == power)
+        {
+            saved = hash;
+            saved_cycle = cycle;
+            power *= 2;
+            distance = 0;
+        }
+        return false;
+    }
+};
+
 #endif // DS_HPP
\ No newline at end of file
@@ -0,0 +1,79 @@
+#include "energy.hpp"
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+static const char *const kind_names[ACT_KINDS] = {"fetch",       "register_read", "register_write", "alu",
+                                                  "forward",     "memory_read",   "memory_write",   "clock"};
+
+// Built-in pJ per access: 32-bit read of an 8 KB instruction SRAM, 64-bit
+// register file ports, a 64-bit adder with its control, one mux level, 64-bit
+// data SRAM accesses, and about 250 flip-flops clocked per cycle
+static const double default_pj[ACT_KINDS] = {5.0, 0.6, 0.9, 0.8, 0.1, 10.0, 12.0, 2.5};
+
+// Stage each structure belongs to; the clock is reported on its own
+static const char *const stage_names[] = {"IF", "ID", "EX", "MEM", "WB"};
+static const int kind_stage[ACT_KINDS] = {0, 1, 4, 2, 2, 3, 3, -1};
+
+energy_table::energy_table()
+{
+    for (int k = 0; k < ACT_KINDS; k++)
+        pj[k] = default_pj[k];
+}
+
+const char *energy_table::name(activity_kind kind) { return kind_names[kind]; }
+
+void energy_table::load(const string &path)
+{
+    ifstream in(path);
+    if (!in.is_open())
+        throw runtime_error("Could not open file " + path);
+    string line;
+    for (int number = 1; getline(in, line); number++)
+    {
+        line = line.substr(0, line.find('#'));
+        istringstream fields(line);
+        string key;
+        double value;
+        if (!(fields >> key))
+            continue;
+        if (!(fields >> value) || value < 0)
+            throw runtime_error(path + ":" + to_string(number) + ": expected \"name pJ\"");
+        int k = 0;
+        while (k < ACT_KINDS && key != kind_names[k])
+            k++;
+        if (k == ACT_KINDS)
+            throw runtime_error(path + ":" + to_string(number) + ": unknown structure " + key);
+        pj[k] = value;
+    }
+}
+
+void report_energy(ostream &out, const activity_counters &activity, const energy_table &table, uint64_t instructions)
+{
+    double energy[ACT_KINDS], stage[5] = {}, total = 0;
+    for (int k = 0; k < ACT_KINDS; k++)
+    {
+        energy[k] = activity.count[k] * table.pj[k];
+        total += energy[k];
+        if (kind_stage[k] >= 0)
+            stage[kind_stage[k]] += energy[k];
+    }
+    double per_instruction = instructions ? total / instructions : 0.0;
+    uint64_t cycles = activity.count[ACT_CLOCK];
+
+    ios_base::fmtflags flags = out.flags();
+    streamsize precision = out.precision();
+    out << fixed << setprecision(3) << "Energy: " << total / 1e3 << " nJ, " << setprecision(1) << per_instruction
+        << " pJ per instruction, " << (cycles ? total / cycles : 0.0) << " pJ per cycle\n";
+    for (int k = 0; k < ACT_KINDS; k++)
+        out << "  " << left << setw(15) << kind_names[k] << right << setw(12) << activity.count[k] << " x "
+            << setw(5) << table.pj[k] << " pJ = " << setw(12) << energy[k] << " pJ ("
+            << (total > 0 ? 100.0 * energy[k] / total : 0.0) << "%)\n";
+    out << "  per stage (pJ per instruction):";
+    for (int s = 0; s < 5; s++)
+        out << " " << stage_names[s] << " " << (instructions ? stage[s] / instructions : 0.0);
+    out << ", clock " << (instructions ? energy[ACT_CLOCK] / instructions : 0.0) << "\n";
+    out.flags(flags);
+    out.precision(precision);
+}
@@ -0,0 +1,48 @@
+#ifndef ENERGY_HPP
+#define ENERGY_HPP
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+// Structures whose accesses are counted for the energy estimate
+enum activity_kind
+{
+    ACT_FETCH,          // instruction memory read (IF)
+    ACT_REGISTER_READ,  // register file read port, x0 excluded (ID)
+    ACT_REGISTER_WRITE, // register file write port (WB)
+    ACT_ALU,            // ALU operation on a real instruction (EX)
+    ACT_FORWARD,        // forwarding mux selecting a bypassed value (EX)
+    ACT_MEMORY_READ,    // data memory or store buffer read (MEM)
+    ACT_MEMORY_WRITE,   // data memory or store buffer write (MEM)
+    ACT_CLOCK,          // one cycle of pipeline latches and clock tree
+    ACT_KINDS
+};
+
+// Access counts per structure. The stages bump them as they go, a few adds per
+// cycle, so they stay on in every run and are only turned into energy when a
+// report asks for it.
+struct activity_counters
+{
+    uint64_t count[ACT_KINDS] = {};
+};
+
+// Energy per access in picojoules. The built-in figures are rough values for
+// a small in-order core in a 45 nm class process; a table file overrides any
+// of them with "name pJ" lines, # starting a comment.
+struct energy_table
+{
+    double pj[ACT_KINDS];
+
+    energy_table();
+    void load(const string &path);
+
+    static const char *name(activity_kind kind);
+};
+
+// Total, per structure, per stage and per retired instruction
+void report_energy(ostream &out, const activity_counters &activity, const energy_table &table, uint64_t instructions);
+
+#endif // ENERGY_HPP
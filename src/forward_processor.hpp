@@ -17,6 +17,7 @@ public:
     void fetch() override;
     void decode() override;
     void execute() override;
+    void resolve_hazards() override;
 };
 
 #endif // FORWARDING_PROCESSOR_HPP
\ No newline at end of file
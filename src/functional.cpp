@@ -0,0 +1,386 @@
+#include "functional.hpp"
+#include <iomanip>
+
+// Longest straight-line run translated into one block
+static const size_t max_block_ops = 64;
+
+FunctionalSimulator::FunctionalSimulator(const vector<uint32_t> &program)
+    : code(program)
+{
+    blocks.resize(code.size());
+    entry_counts.assign(code.size(), 0);
+    devices.cycle_source = [this]() { return retired_so_far(); };
+    devices.attach(bus);
+}
+
+bool FunctionalSimulator::step_interpreted()
+{
+    if (pc % 4 != 0 || pc / 4 >= code.size() || devices.halted)
+        return false;
+
+    uint32_t instruction = code[pc / 4];
+    uint32_t opcode = instruction & 0x7F;
+    uint8_t rd = (instruction >> 7) & 0x1F;
+    uint8_t rs1 = (instruction >> 15) & 0x1F;
+    uint8_t rs2 = (instruction >> 20) & 0x1F;
+    uint32_t funct3 = (instruction >> 12) & 0x7;
+
+    imm_gen gen;
+    gen.instruction = instruction;
+    gen.generate();
+
+    // Same decoders as the pipeline's ID and EX stages
+    ControlSignals control = Processor::decode_control(instruction);
+    int64_t operand1 = registers[rs1];
+    int64_t operand2 = control.aluSrc ? gen.extended : registers[rs2];
+    int64_t result = ALU::compute(operand1, operand2, Processor::decode_alu_op(instruction, control.aluOp));
+
+    uint64_t next_pc = pc + 4;
+    if (opcode == 0x63)
+    {
+        bool equal = registers[rs1] == registers[rs2];
+        if ((funct3 == 0x0 && equal) || (funct3 == 0x1 && !equal))
+            next_pc = pc + gen.extended;
+    }
+    else if (opcode == 0x6F)
+    {
+        result = pc + 4;
+        next_pc = pc + gen.extended;
+    }
+    else if (opcode == 0x67)
+    {
+        result = pc + 4;
+        next_pc = registers[rs1] + gen.extended;
+    }
+    else if (is_csr_instruction(instruction))
+    {
+        result = csr_access(instruction, registers[rs1], counters.instructions);
+    }
+
+    if (control.memRead)
+        result = load(result);
+    if (control.memWrite)
+        store(result, registers[rs2]);
+    if (control.regWrite && rd != 0)
+        registers[rd] = result;
+
+    pc = next_pc;
+    counters.instructions++;
+    counters.interpreted++;
+    return true;
+}
+
+/*                     Closure-threaded micro-op handlers                     */
+
+template <ALU::Operation OP>
+bool FunctionalSimulator::op_alu_reg(FunctionalSimulator &sim, const micro_op &op)
+{
+    sim.registers[op.rd] = ALU::compute(sim.registers[op.rs1], sim.registers[op.rs2], OP);
+    return true;
+}
+
+template <ALU::Operation OP>
+bool FunctionalSimulator::op_alu_imm(FunctionalSimulator &sim, const micro_op &op)
+{
+    sim.registers[op.rd] = ALU::compute(sim.registers[op.rs1], op.imm, OP);
+    return true;
+}
+
+bool FunctionalSimulator::op_load(FunctionalSimulator &sim, const micro_op &op)
+{
+    sim.registers[op.rd] = sim.load(sim.registers[op.rs1] + op.imm);
+    return true;
+}
+
+bool FunctionalSimulator::op_store(FunctionalSimulator &sim, const micro_op &op)
+{
+    if (sim.store(sim.registers[op.rs1] + op.imm, sim.registers[op.rs2]))
+        return true;
+    // The block itself may have been rewritten, or the program exited; leave it right after the store
+    sim.pc = op.pc + 4;
+    return false;
+}
+
+bool FunctionalSimulator::op_beq(FunctionalSimulator &sim, const micro_op &op)
+{
+    sim.pc = (sim.registers[op.rs1] == sim.registers[op.rs2]) ? op.pc + op.imm : op.pc + 4;
+    return false;
+}
+
+bool FunctionalSimulator::op_bne(FunctionalSimulator &sim, const micro_op &op)
+{
+    sim.pc = (sim.registers[op.rs1] != sim.registers[op.rs2]) ? op.pc + op.imm : op.pc + 4;
+    return false;
+}
+
+bool FunctionalSimulator::op_jal(FunctionalSimulator &sim, const micro_op &op)
+{
+    sim.pc = op.pc + op.imm;
+    if (op.rd != 0)
+        sim.registers[op.rd] = op.pc + 4;
+    return false;
+}
+
+bool FunctionalSimulator::op_jalr(FunctionalSimulator &sim, const micro_op &op)
+{
+    sim.pc = sim.registers[op.rs1] + op.imm;
+    if (op.rd != 0)
+        sim.registers[op.rd] = op.pc + 4;
+    return false;
+}
+
+// imm holds the instruction word
+bool FunctionalSimulator::op_csr(FunctionalSimulator &sim, const micro_op &op)
+{
+    int64_t value = sim.csr_access((uint32_t)op.imm, sim.registers[op.rs1], sim.retired_so_far());
+    if (op.rd != 0)
+        sim.registers[op.rd] = value;
+    return true;
+}
+
+bool FunctionalSimulator::op_nop(FunctionalSimulator &, const micro_op &)
+{
+    return true;
+}
+
+FunctionalSimulator::handler FunctionalSimulator::alu_handler(ALU::Operation operation, bool immediate)
+{
+#define ALU_CASE(name)              \
+    case ALU::Operation::name:      \
+        return immediate ? &op_alu_imm<ALU::Operation::name> : &op_alu_reg<ALU::Operation::name>;
+
+    switch (operation)
+    {
+        ALU_CASE(ADD)
+        ALU_CASE(SUB)
+        ALU_CASE(AND)
+        ALU_CASE(OR)
+        ALU_CASE(XOR)
+        ALU_CASE(SLL)
+        ALU_CASE(SRL)
+        ALU_CASE(SRA)
+        ALU_CASE(SLT)
+        ALU_CASE(SLTU)
+    }
+#undef ALU_CASE
+    return &op_nop;
+}
+
+/*                              Block cache                                   */
+
+unique_ptr<FunctionalSimulator::block> FunctionalSimulator::translate(uint64_t start_pc) const
+{
+    auto b = make_unique<block>();
+    uint64_t block_pc = start_pc;
+
+    while (block_pc / 4 < code.size() && b->ops.size() < max_block_ops)
+    {
+        uint32_t instruction = code[block_pc / 4];
+        uint32_t opcode = instruction & 0x7F;
+        uint32_t funct3 = (instruction >> 12) & 0x7;
+
+        imm_gen gen;
+        gen.instruction = instruction;
+        gen.generate();
+
+        micro_op op;
+        op.fn = &op_nop;
+        op.rd = (instruction >> 7) & 0x1F;
+        op.rs1 = (instruction >> 15) & 0x1F;
+        op.rs2 = (instruction >> 20) & 0x1F;
+        op.imm = gen.extended;
+        op.pc = block_pc;
+
+        bool ends_block = false;
+        switch (opcode)
+        {
+        case 0x33:
+            if (op.rd != 0)
+                op.fn = alu_handler(Processor::decode_alu_op(instruction, 2), false);
+            break;
+        case 0x13:
+            if (op.rd != 0)
+                op.fn = alu_handler(Processor::decode_alu_op(instruction, 2), true);
+            break;
+        case 0x03:
+            if (op.rd != 0)
+                op.fn = &op_load;
+            break;
+        case 0x23:
+            op.fn = &op_store;
+            break;
+        case 0x63:
+            // Only beq/bne are resolved by the pipeline; other branches never take
+            if (funct3 == 0x0 || funct3 == 0x1)
+            {
+                op.fn = (funct3 == 0x0) ? &op_beq : &op_bne;
+                ends_block = true;
+            }
+            break;
+        case 0x6F:
+            op.fn = &op_jal;
+            ends_block = true;
+            break;
+        case 0x67:
+            op.fn = &op_jalr;
+            ends_block = true;
+            break;
+        case 0x73:
+            if (is_csr_instruction(instruction))
+            {
+                op.fn = &op_csr;
+                op.imm = instruction;
+            }
+            break;
+        }
+
+        b->ops.push_back(op);
+        block_pc += 4;
+        if (ends_block)
+            break;
+    }
+
+    b->end_pc = block_pc;
+    return b;
+}
+
+void FunctionalSimulator::execute_block(const block &b)
+{
+    counters.block_executions++;
+    const size_t n = b.ops.size();
+    for (size_t i = 0; i < n; i++)
+    {
+        const micro_op &op = b.ops[i];
+        block_position = i;
+        if (!op.fn(*this, op))
+        {
+            block_position = 0;
+            counters.instructions += i + 1;
+            return;
+        }
+    }
+    block_position = 0;
+    counters.instructions += n;
+    pc = b.end_pc;
+}
+
+int64_t FunctionalSimulator::load(uint64_t address) const
+{
+    if (address >= mmio_base)
+        return bus.read(address);
+    auto it = data_mem.data_memory.find(address);
+    return (it == data_mem.data_memory.end()) ? 0 : it->second;
+}
+
+bool FunctionalSimulator::store(uint64_t address, int64_t value)
+{
+    if (address >= mmio_base)
+    {
+        bus.write(address, value);
+        return !devices.halted;
+    }
+
+    int64_t &cell = data_mem.data_memory[address];
+    data_mem.state_hash ^= state_mix(address, cell) ^ state_mix(address, value);
+    cell = value;
+    if (address >= code_bytes)
+        return true;
+
+    // Translations are dropped by run() once the current block has been left
+    code[address / 4] = (uint32_t)value;
+    code_dirty = true;
+    return false;
+}
+
+int64_t FunctionalSimulator::csr_access(uint32_t instruction, int64_t rs1_value, uint64_t retired)
+{
+    uint64_t old_value = 0;
+    switch (csr_number(instruction))
+    {
+    case CSR_CYCLE:
+    case CSR_TIME:
+    case CSR_INSTRET:
+        old_value = retired;
+        break;
+    case CSR_ROI:
+        old_value = roi.value;
+        if (csr_writes(instruction))
+        {
+            pipeline_counters now;
+            now.cycles = now.instructions = retired;
+            roi.write(csr_new_value(instruction, old_value, rs1_value), now);
+        }
+        break;
+    }
+    return (int64_t)old_value;
+}
+
+void FunctionalSimulator::invalidate_all()
+{
+    for (auto &b : blocks)
+        b.reset();
+    fill(entry_counts.begin(), entry_counts.end(), 0);
+    code_dirty = false;
+    counters.invalidations++;
+}
+
+uint64_t FunctionalSimulator::run(uint64_t max_instructions)
+{
+    uint64_t start = counters.instructions;
+    while (counters.instructions - start < max_instructions)
+    {
+        size_t index = pc / 4;
+        if (pc % 4 != 0 || index >= code.size() || devices.halted)
+            break;
+
+        if (code_dirty)
+            invalidate_all();
+
+        if (use_blocks)
+        {
+            block *b = blocks[index].get();
+            if (!b && ++entry_counts[index] >= hot_threshold)
+            {
+                blocks[index] = translate(pc);
+                b = blocks[index].get();
+                counters.translated_blocks++;
+            }
+            // Never overshoot the instruction budget inside a block
+            if (b && b->ops.size() <= max_instructions - (counters.instructions - start))
+            {
+                execute_block(*b);
+                continue;
+            }
+        }
+
+        step_interpreted();
+    }
+    return counters.instructions - start;
+}
+
+uint64_t FunctionalSimulator::state_hash() const
+{
+    uint64_t hash = data_mem.state_hash * 0x9E3779B97F4A7C15ull;
+    for (int i = 1; i < 32; i++)
+        hash ^= state_mix(i, registers[i]);
+    hash ^= state_mix(~0ull, (int64_t)pc) ^ state_mix(~1ull, (int64_t)roi.value);
+    return hash;
+}
+
+void FunctionalSimulator::print_state(ostream &out) const
+{
+    for (int i = 0; i < 32; i++)
+        out << "x" << i << " = " << registers[i] << "\n";
+    for (const auto &entry : data_mem.data_memory)
+        out << "mem[" << entry.first << "] = " << entry.second << "\n";
+    out << "\nInstructions: " << counters.instructions << " (" << counters.interpreted << " interpreted, "
+        << counters.translated_blocks << " blocks translated, " << counters.block_executions
+        << " block runs, " << counters.invalidations << " invalidations)\n";
+    if (roi.regions)
+    {
+        pipeline_counters now;
+        now.cycles = now.instructions = counters.instructions;
+        out << "Region of interest: " << roi.measured(now).instructions << " instructions in " << roi.regions
+            << " region(s)\n";
+    }
+}
@@ -0,0 +1,128 @@
+#ifndef FUNCTIONAL_HPP
+#define FUNCTIONAL_HPP
+
+#include "processor.hpp"
+#include <memory>
+
+// Instruction-at-a-time functional simulator (no pipeline timing). Hot basic
+// blocks are translated once into closure-threaded code: an array of
+// pre-decoded micro-ops, each carrying a handler specialised for its operation,
+// so the per-instruction decode disappears from the loop.
+class FunctionalSimulator
+{
+public:
+    struct micro_op;
+    typedef bool (*handler)(FunctionalSimulator &sim, const micro_op &op);
+
+    struct micro_op
+    {
+        handler fn;
+        uint8_t rd;
+        uint8_t rs1;
+        uint8_t rs2;
+        int64_t imm;
+        uint64_t pc;
+    };
+
+    struct block
+    {
+        vector<micro_op> ops;
+        uint64_t end_pc = 0;
+    };
+
+    struct stats
+    {
+        uint64_t instructions = 0;
+        uint64_t interpreted = 0;
+        uint64_t translated_blocks = 0;
+        uint64_t block_executions = 0;
+        uint64_t invalidations = 0;
+    };
+
+    // Architectural state
+    int64_t registers[32] = {0};
+    data_memory data_mem;
+    uint64_t pc = 0;
+
+private:
+    vector<uint32_t> code;
+    vector<unique_ptr<block>> blocks; // indexed by pc / 4
+    vector<uint32_t> entry_counts;
+    uint32_t hot_threshold = 16;
+    bool use_blocks = true;
+
+    // Bytes of data address space that alias the code (0 for split memories)
+    uint64_t code_bytes = 0;
+    bool code_dirty = false;
+
+    stats counters;
+    // Ops of the running block already executed; a block's instructions are
+    // only added to counters when it ends, so counter reads inside it add this
+    uint64_t block_position = 0;
+
+    // Console and exit devices; the cycle register counts retired instructions
+    mmio_bus bus;
+    standard_devices devices;
+
+    // roi CSR; with no timing, a region is measured in instructions only
+    region_of_interest roi;
+
+    unique_ptr<block> translate(uint64_t start_pc) const;
+    void execute_block(const block &b);
+    int64_t load(uint64_t address) const;
+    // Stores into the code region rewrite the instruction and drop translations;
+    // false means the current block must be left
+    bool store(uint64_t address, int64_t value);
+    // Instructions retired before the one executing now
+    uint64_t retired_so_far() const { return counters.instructions + block_position; }
+    // Zicsr access with retired instructions before it; cycle and time count instructions too
+    int64_t csr_access(uint32_t instruction, int64_t rs1_value, uint64_t retired);
+
+    template <ALU::Operation OP>
+    static bool op_alu_reg(FunctionalSimulator &sim, const micro_op &op);
+    template <ALU::Operation OP>
+    static bool op_alu_imm(FunctionalSimulator &sim, const micro_op &op);
+    static bool op_load(FunctionalSimulator &sim, const micro_op &op);
+    static bool op_store(FunctionalSimulator &sim, const micro_op &op);
+    static bool op_beq(FunctionalSimulator &sim, const micro_op &op);
+    static bool op_bne(FunctionalSimulator &sim, const micro_op &op);
+    static bool op_jal(FunctionalSimulator &sim, const micro_op &op);
+    static bool op_jalr(FunctionalSimulator &sim, const micro_op &op);
+    static bool op_csr(FunctionalSimulator &sim, const micro_op &op);
+    static bool op_nop(FunctionalSimulator &sim, const micro_op &op);
+
+    static handler alu_handler(ALU::Operation operation, bool immediate);
+
+public:
+    explicit FunctionalSimulator(const vector<uint32_t> &program);
+    FunctionalSimulator(const FunctionalSimulator &) = delete;
+    FunctionalSimulator &operator=(const FunctionalSimulator &) = delete;
+
+    // Decode-every-time interpreter step; false once the PC leaves the program
+    bool step_interpreted();
+
+    // Run until the PC leaves the program, the program exits or max_instructions retire
+    uint64_t run(uint64_t max_instructions);
+
+    // Disable translation to measure the plain interpreter
+    void set_block_cache(bool enabled) { use_blocks = enabled; }
+    void set_hot_threshold(uint32_t entries) { hot_threshold = entries; }
+    // Map the code at data address 0 so stores can modify it
+    void set_unified_memory(bool enabled) { code_bytes = enabled ? code.size() * 4 : 0; }
+    void invalidate_all();
+
+    mmio_bus &mmio() { return bus; }
+    void set_console(ostream *out) { devices.console = out; }
+    void flush_console() { devices.flush_console(); }
+    bool halted() const { return devices.halted; }
+    int64_t exit_code() const { return devices.exit_code; }
+
+    // Registers, pc, memory and the roi CSR, for loop detection between run() calls;
+    // memory keeps its incremental hash (data_mem.state_hash), registers are hashed here
+    uint64_t state_hash() const;
+
+    const stats &statistics() const { return counters; }
+    void print_state(ostream &out) const;
+};
+
+#endif // FUNCTIONAL_HPP
@@ -0,0 +1,145 @@
+#include "hazard_batch.hpp"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define HAZARD_SIMD 32
+typedef __m256i lane_vec;
+static inline lane_vec load_lanes(const uint8_t *p) { return _mm256_loadu_si256((const __m256i *)p); }
+static inline void store_lanes(uint8_t *p, lane_vec v) { _mm256_storeu_si256((__m256i *)p, v); }
+static inline lane_vec splat(uint8_t x) { return _mm256_set1_epi8((char)x); }
+static inline lane_vec lanes_eq(lane_vec a, lane_vec b) { return _mm256_cmpeq_epi8(a, b); }
+static inline lane_vec lanes_and(lane_vec a, lane_vec b) { return _mm256_and_si256(a, b); }
+static inline lane_vec lanes_or(lane_vec a, lane_vec b) { return _mm256_or_si256(a, b); }
+static inline lane_vec lanes_andnot(lane_vec a, lane_vec b) { return _mm256_andnot_si256(a, b); }
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define HAZARD_SIMD 16
+typedef __m128i lane_vec;
+static inline lane_vec load_lanes(const uint8_t *p) { return _mm_loadu_si128((const __m128i *)p); }
+static inline void store_lanes(uint8_t *p, lane_vec v) { _mm_storeu_si128((__m128i *)p, v); }
+static inline lane_vec splat(uint8_t x) { return _mm_set1_epi8((char)x); }
+static inline lane_vec lanes_eq(lane_vec a, lane_vec b) { return _mm_cmpeq_epi8(a, b); }
+static inline lane_vec lanes_and(lane_vec a, lane_vec b) { return _mm_and_si128(a, b); }
+static inline lane_vec lanes_or(lane_vec a, lane_vec b) { return _mm_or_si128(a, b); }
+static inline lane_vec lanes_andnot(lane_vec a, lane_vec b) { return _mm_andnot_si128(a, b); }
+#endif
+
+#ifdef HAZARD_SIMD
+// All-ones in lanes where the byte is non-zero
+static inline lane_vec lanes_set(lane_vec v)
+{
+    return lanes_andnot(lanes_eq(v, splat(0)), splat(0xFF));
+}
+
+// All-ones where rd is written, is not x0, and matches rs1 or rs2
+static inline lane_vec lanes_match(lane_vec rd, lane_vec writes, lane_vec rs1, lane_vec rs2)
+{
+    lane_vec same = lanes_or(lanes_eq(rd, rs1), lanes_eq(rd, rs2));
+    return lanes_and(lanes_andnot(lanes_eq(rd, splat(0)), same), writes);
+}
+#endif
+
+static inline bool scalar_match(uint8_t rd, bool writes, uint8_t rs1, uint8_t rs2)
+{
+    return (source_mask(rs1, rs2) & dest_mask(rd, writes)) != 0;
+}
+
+void detect_stalls_batch(const hazard_lanes &l, bool forwarding, uint8_t *stall)
+{
+    size_t i = 0;
+#ifdef HAZARD_SIMD
+    for (; i + HAZARD_SIMD <= l.count; i += HAZARD_SIMD)
+    {
+        lane_vec rs1 = load_lanes(l.rs1 + i);
+        lane_vec rs2 = load_lanes(l.rs2 + i);
+        lane_vec ex_rd = load_lanes(l.id_ex_rd + i);
+        lane_vec ex_load = lanes_set(load_lanes(l.id_ex_memRead + i));
+        lane_vec ex_writes = lanes_or(lanes_set(load_lanes(l.id_ex_regWrite + i)), ex_load);
+        lane_vec mem_writes = lanes_set(lanes_or(load_lanes(l.ex_mem_regWrite + i), load_lanes(l.ex_mem_memRead + i)));
+
+        lane_vec in_flight = lanes_or(lanes_match(ex_rd, ex_writes, rs1, rs2),
+                                      lanes_match(load_lanes(l.ex_mem_rd + i), mem_writes, rs1, rs2));
+        lane_vec result;
+        if (forwarding)
+        {
+            lane_vec load_use = lanes_match(ex_rd, ex_load, rs1, rs2);
+            result = lanes_or(load_use, lanes_and(in_flight, lanes_set(load_lanes(l.is_branch + i))));
+        }
+        else
+        {
+            result = in_flight;
+        }
+        store_lanes(stall + i, lanes_and(result, splat(1)));
+    }
+#endif
+    for (; i < l.count; i++)
+    {
+        bool in_flight = scalar_match(l.id_ex_rd[i], l.id_ex_regWrite[i] || l.id_ex_memRead[i], l.rs1[i], l.rs2[i]) ||
+                         scalar_match(l.ex_mem_rd[i], l.ex_mem_regWrite[i] || l.ex_mem_memRead[i], l.rs1[i], l.rs2[i]);
+        if (forwarding)
+            stall[i] = scalar_match(l.id_ex_rd[i], l.id_ex_memRead[i], l.rs1[i], l.rs2[i]) ||
+                       (l.is_branch[i] && in_flight);
+        else
+            stall[i] = in_flight;
+    }
+}
+
+void detect_forwarding_batch(const forwarding_lanes &l, uint8_t *forwardA, uint8_t *forwardB)
+{
+    size_t i = 0;
+#ifdef HAZARD_SIMD
+    for (; i + HAZARD_SIMD <= l.count; i += HAZARD_SIMD)
+    {
+        lane_vec mem_rd = load_lanes(l.ex_mem_rd + i);
+        lane_vec wb_rd = load_lanes(l.mem_wb_rd + i);
+        lane_vec mem_valid = lanes_andnot(lanes_eq(mem_rd, splat(0)), lanes_set(load_lanes(l.ex_mem_regWrite + i)));
+        lane_vec wb_valid = lanes_andnot(lanes_eq(wb_rd, splat(0)), lanes_set(load_lanes(l.mem_wb_regWrite + i)));
+
+        const uint8_t *sources[2] = {l.rs1 + i, l.rs2 + i};
+        uint8_t *outputs[2] = {forwardA + i, forwardB + i};
+        for (int s = 0; s < 2; s++)
+        {
+            lane_vec rs = load_lanes(sources[s]);
+            lane_vec from_mem = lanes_and(mem_valid, lanes_eq(mem_rd, rs));
+            lane_vec from_wb = lanes_and(wb_valid, lanes_eq(wb_rd, rs));
+            lane_vec select = lanes_or(lanes_and(from_mem, splat(2)), lanes_andnot(from_mem, lanes_and(from_wb, splat(1))));
+            store_lanes(outputs[s], select);
+        }
+    }
+#endif
+    for (; i < l.count; i++)
+    {
+        uint32_t ex_mem = dest_mask(l.ex_mem_rd[i], l.ex_mem_regWrite[i]);
+        uint32_t mem_wb = dest_mask(l.mem_wb_rd[i], l.mem_wb_regWrite[i]);
+        uint32_t a = reg_bit(l.rs1[i]);
+        uint32_t b = reg_bit(l.rs2[i]);
+        forwardA[i] = (a & ex_mem) ? 2 : (a & mem_wb) ? 1 : 0;
+        forwardB[i] = (b & ex_mem) ? 2 : (b & mem_wb) ? 1 : 0;
+    }
+}
+
+uint32_t group_dependences(const uint8_t *rd, const uint8_t *writes,
+                           const uint8_t *rs1, const uint8_t *rs2, size_t count)
+{
+    // Scoreboard of registers written by older group members
+    uint32_t written = 0;
+    uint32_t dependent = 0;
+    for (size_t i = 0; i < count && i < 32; i++)
+    {
+        if (source_mask(rs1[i], rs2[i]) & written)
+            dependent |= 1u << i;
+        written |= dest_mask(rd[i], writes[i]);
+    }
+    return dependent;
+}
+
+const char *hazard_batch_isa()
+{
+#if defined(__AVX2__)
+    return "avx2";
+#elif defined(__SSE2__)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
@@ -0,0 +1,59 @@
+#ifndef HAZARD_BATCH_HPP
+#define HAZARD_BATCH_HPP
+
+#include "ds.hpp"
+
+// Hazard and forwarding detection for many independent pipelines at once.
+// Each field is a structure-of-arrays byte vector with one entry per lane
+// (flags are 0/1), so a whole batch is checked with a few compares per 16
+// lanes (SSE2) or 32 lanes (AVX2, when built with -mavx2 / NATIVE=1).
+// Results match Forward_HazardDetectionUnit / HazardDetectionUnit::stall and
+// ForwardingUnit::forwardA/B lane for lane.
+
+struct hazard_lanes
+{
+    size_t count = 0;
+
+    // Instruction in ID
+    const uint8_t *rs1 = nullptr;
+    const uint8_t *rs2 = nullptr;
+    const uint8_t *is_branch = nullptr; // only read by the forwarding pipeline
+
+    // Older instructions still in flight
+    const uint8_t *id_ex_rd = nullptr;
+    const uint8_t *id_ex_regWrite = nullptr;
+    const uint8_t *id_ex_memRead = nullptr;
+    const uint8_t *ex_mem_rd = nullptr;
+    const uint8_t *ex_mem_regWrite = nullptr;
+    const uint8_t *ex_mem_memRead = nullptr;
+};
+
+struct forwarding_lanes
+{
+    size_t count = 0;
+
+    // Instruction in EX
+    const uint8_t *rs1 = nullptr;
+    const uint8_t *rs2 = nullptr;
+
+    const uint8_t *ex_mem_rd = nullptr;
+    const uint8_t *ex_mem_regWrite = nullptr;
+    const uint8_t *mem_wb_rd = nullptr;
+    const uint8_t *mem_wb_regWrite = nullptr;
+};
+
+// stall[i] = 1 when lane i must hold its ID instruction this cycle
+void detect_stalls_batch(const hazard_lanes &lanes, bool forwarding, uint8_t *stall);
+
+// forwardA/B[i] = 2 (EX/MEM), 1 (MEM/WB) or 0 (register file)
+void detect_forwarding_batch(const forwarding_lanes &lanes, uint8_t *forwardA, uint8_t *forwardB);
+
+// For a group of up to 32 instructions issued together (oldest first), bit i is
+// set when instruction i reads a register written by an older one in the group.
+uint32_t group_dependences(const uint8_t *rd, const uint8_t *writes,
+                           const uint8_t *rs1, const uint8_t *rs2, size_t count);
+
+// Name of the vector path compiled in ("avx2", "sse2" or "scalar")
+const char *hazard_batch_isa();
+
+#endif // HAZARD_BATCH_HPP
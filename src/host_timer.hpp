@@ -0,0 +1,114 @@
+#ifndef HOST_TIMER_HPP
+#define HOST_TIMER_HPP
+
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+using namespace std;
+
+// Host-side self profiling of the simulator. Build with HOST_PROFILE=1
+// (-DPROCSIM_HOST_PROFILE) to enable; otherwise HOST_TIMED() expands to the bare
+// statement and nothing below is ever touched.
+
+enum host_slot
+{
+    // Pipeline stages, as called from Processor::step()
+    HOST_WRITE_BACK,
+    HOST_MEMORY,
+    HOST_EXECUTE,
+    HOST_DECODE,
+    HOST_FETCH,
+    HOST_DIAGRAM,
+    HOST_PROFILER,
+    // Subsystems, nested inside the stages above
+    HOST_HAZARD,
+    HOST_FORWARDING,
+    HOST_ALU,
+    HOST_DATA_MEMORY,
+    HOST_REGISTER_FILE,
+    HOST_SLOTS
+};
+
+struct host_timers
+{
+    uint64_t ticks[HOST_SLOTS] = {0};
+    uint64_t calls[HOST_SLOTS] = {0};
+
+    // Wall clock and tick counter at reset, used to convert ticks to nanoseconds
+    uint64_t start_ticks = 0;
+    chrono::steady_clock::time_point start_time;
+
+    static uint64_t now()
+    {
+#if defined(__x86_64__) || defined(__i386__)
+        return __rdtsc();
+#else
+        return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+    }
+
+    void reset()
+    {
+        for (int i = 0; i < HOST_SLOTS; i++)
+            ticks[i] = calls[i] = 0;
+        start_ticks = now();
+        start_time = chrono::steady_clock::now();
+    }
+
+    void report(ostream &out, uint64_t simulated_cycles) const
+    {
+        static const char *const names[HOST_SLOTS] = {
+            "write_back", "memory_access", "execute", "decode", "fetch",
+            "pipeline_diagram", "profiler",
+            "  hazard detection", "  forwarding", "  ALU", "  data memory", "  register file"};
+
+        double elapsed_ns = chrono::duration<double, nano>(chrono::steady_clock::now() - start_time).count();
+        uint64_t elapsed_ticks = now() - start_ticks;
+        double ns_per_tick = elapsed_ticks ? elapsed_ns / elapsed_ticks : 1.0;
+        double cycles = simulated_cycles ? (double)simulated_cycles : 1.0;
+
+        out << "Host time per stage (" << simulated_cycles << " simulated cycles, "
+            << fixed << setprecision(3) << elapsed_ns / 1e6 << " ms wall)\n";
+        out << left << setw(20) << "stage" << right << setw(12) << "total ms" << setw(14)
+            << "ns/cycle" << setw(10) << "% wall" << setw(14) << "calls" << "\n";
+        for (int i = 0; i < HOST_SLOTS; i++)
+        {
+            double ns = ticks[i] * ns_per_tick;
+            out << left << setw(20) << names[i] << right << setw(12) << setprecision(3) << ns / 1e6
+                << setw(14) << setprecision(1) << ns / cycles << setw(10) << setprecision(1)
+                << (elapsed_ns > 0 ? 100.0 * ns / elapsed_ns : 0.0) << setw(14) << calls[i] << "\n";
+        }
+    }
+};
+
+struct host_scoped_timer
+{
+    host_timers &timers;
+    host_slot slot;
+    uint64_t start;
+
+    host_scoped_timer(host_timers &t, host_slot s) : timers(t), slot(s), start(host_timers::now()) {}
+    ~host_scoped_timer()
+    {
+        timers.ticks[slot] += host_timers::now() - start;
+        timers.calls[slot]++;
+    }
+};
+
+#ifdef PROCSIM_HOST_PROFILE
+#define HOST_TIMED(timers, slot, statement)           \
+    {                                                 \
+        host_scoped_timer host_timer_(timers, slot);  \
+        statement;                                    \
+    }
+#else
+#define HOST_TIMED(timers, slot, statement) statement
+#endif
+
+#endif // HOST_TIMER_HPP
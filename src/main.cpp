@@ -0,0 +1,346 @@
+#include "simulator.hpp"
+#include "debugger.hpp"
+#include "functional.hpp"
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <optional>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+static void usage(const char* program) {
+    std::cerr << "Usage: " << program << " <program_file> [num_cycles] [options]\n"
+              << "  without num_cycles the run goes on until the program finishes or provably loops; 0 runs no cycles\n"
+              << "  --mode=forward|noforward        pipeline to simulate (default forward)\n"
+              << "  --diagram=text|csv|json|bin     pipeline diagram format (default text)\n"
+              << "  --diagram=none                  record no diagram, only the cycle count\n"
+              << "  --output-dir=DIR                where <name>_<mode>_out.<ext> goes (default ../outputfiles)\n"
+              << "  --output=FILE                   exact output file, '-' for stdout\n"
+              << "  --mem=FILE[@BASE][:WIDTH]       preload data memory (.bin raw words or hex text), repeatable\n"
+              << "  --regs=FILE                     preload registers (.bin or \"xN value\" lines)\n"
+              << "  --trace                         program_file is a recorded trace to replay through the pipeline\n"
+              << "  --record-trace=FILE             write the committed instruction trace of this run\n"
+              << "  --stats=FILE[:N[i]]             CSV statistics row every N cycles (N instructions with i, default 10000)\n"
+              << "  --store-buffer=N[:DRAIN]        N-entry store buffer draining one entry every DRAIN cycles\n"
+              << "  --store-sets[=WINDOW]           evaluate hoisting loads over the stores in a WINDOW-instruction window (16)\n"
+              << "  --wrong-path                    report the squashed wrong-path instructions on stderr\n"
+              << "  --energy[=TABLE]                estimate energy per instruction and stage (TABLE: \"name pJ\" lines)\n"
+              << "  --threaded                      record the diagram and trace on a second thread\n"
+              << "  --timeout=SECONDS               wall-clock watchdog (exit status 124)\n"
+              << "  --debug                         interactive debugger on stdin/stderr\n"
+              << "  --profile                       write <name>_<mode>_profile.txt/.folded\n"
+              << "  --functional[=interp]           functional run, num_cycles is an instruction budget\n";
+}
+
+int main(int argc, char* argv[]) {
+    try {
+        if (argc < 2) {
+            usage(argv[0]);
+            return 1;
+        }
+        // The cycle budget is optional; an explicit 0 is a budget of no cycles, not "none given"
+        std::optional<uint64_t> num_cycles;
+        if (argc >= 3 && std::string(argv[2]).rfind("--", 0) != 0) {
+            num_cycles = std::stoull(argv[2]);
+        }
+
+        PipelineMode mode = PipelineMode::Forward;
+        diagram_format format = diagram_format::text;
+        bool recordDiagram = true;
+        std::string outputDir = "../outputfiles";
+        std::string outputPath;
+        bool debug = false;
+        bool profile = false;
+        std::string functional;
+        std::vector<std::string> memoryImages;
+        std::string registerImage;
+        bool replay = false;
+        std::string recordTrace;
+        std::string statsPath;
+        uint64_t statsInterval = 10000;
+        stats_writer::interval_unit statsUnit = stats_writer::Cycles;
+        size_t storeBufferEntries = 0;
+        uint32_t storeBufferDrain = 1;
+        double timeout = 0;
+        bool wrongPath = false;
+        size_t storeSetWindow = 0;
+        bool threaded = false;
+        bool energy = false;
+        energy_table energyTable;
+
+        for (int i = num_cycles ? 3 : 2; i < argc; i++) {
+            std::string option = argv[i];
+            if (option.rfind("--mode=", 0) == 0) {
+                mode = parse_pipeline_mode(option.substr(7));
+            } else if (option.rfind("--diagram=", 0) == 0) {
+                if (option == "--diagram=none") {
+                    recordDiagram = false;
+                } else {
+                    format = parse_diagram_format(option.substr(10));
+                }
+            } else if (option.rfind("--output-dir=", 0) == 0) {
+                outputDir = option.substr(13);
+            } else if (option.rfind("--output=", 0) == 0) {
+                outputPath = option.substr(9);
+            } else if (option.rfind("--mem=", 0) == 0) {
+                memoryImages.push_back(option.substr(6));
+            } else if (option.rfind("--regs=", 0) == 0) {
+                registerImage = option.substr(7);
+            } else if (option == "--trace") {
+                replay = true;
+            } else if (option.rfind("--record-trace=", 0) == 0) {
+                recordTrace = option.substr(15);
+            } else if (option.rfind("--stats=", 0) == 0) {
+                std::string spec = option.substr(8);
+                size_t colon = spec.rfind(':');
+                statsPath = spec.substr(0, colon);
+                if (colon != std::string::npos) {
+                    std::string every = spec.substr(colon + 1);
+                    if (!every.empty() && every.back() == 'i') {
+                        statsUnit = stats_writer::Instructions;
+                        every.pop_back();
+                    }
+                    statsInterval = std::stoull(every);
+                }
+            } else if (option.rfind("--store-buffer=", 0) == 0) {
+                std::string spec = option.substr(15);
+                size_t colon = spec.find(':');
+                storeBufferEntries = std::stoul(spec.substr(0, colon));
+                if (colon != std::string::npos) {
+                    storeBufferDrain = std::stoul(spec.substr(colon + 1));
+                }
+            } else if (option.rfind("--timeout=", 0) == 0) {
+                timeout = std::stod(option.substr(10));
+            } else if (option == "--store-sets" || option.rfind("--store-sets=", 0) == 0) {
+                storeSetWindow = option == "--store-sets" ? 16 : std::stoul(option.substr(13));
+            } else if (option == "--energy" || option.rfind("--energy=", 0) == 0) {
+                energy = true;
+                if (option != "--energy") {
+                    energyTable.load(option.substr(9));
+                }
+            } else if (option == "--threaded") {
+                threaded = true;
+            } else if (option == "--wrong-path") {
+                wrongPath = true;
+            } else if (option == "--debug") {
+                debug = true;
+            } else if (option == "--profile") {
+                profile = true;
+            } else if (option == "--functional" || option == "--functional=interp") {
+                functional = option == "--functional" ? "blocks" : "interp";
+            } else {
+                std::cerr << "Unknown option " << option << std::endl;
+                usage(argv[0]);
+                return 1;
+            }
+        }
+
+        if (replay && (!functional.empty() || profile || !memoryImages.empty() || !registerImage.empty())) {
+            std::cerr << "--trace replays timing only; --functional, --profile, --mem and --regs do not apply" << std::endl;
+            return 1;
+        }
+        if (!recordTrace.empty() && !functional.empty()) {
+            std::cerr << "--record-trace records a pipeline run, not --functional" << std::endl;
+            return 1;
+        }
+        if (!statsPath.empty() && !functional.empty()) {
+            std::cerr << "--stats samples a pipeline run, not --functional" << std::endl;
+            return 1;
+        }
+        if (energy && !functional.empty()) {
+            std::cerr << "--energy counts pipeline activity, not --functional" << std::endl;
+            return 1;
+        }
+
+        Simulator simulator(mode);
+        simulator.configure_store_buffer(storeBufferEntries, storeBufferDrain);
+        simulator.configure_store_sets(storeSetWindow);
+        simulator.record_diagram(recordDiagram);
+        simulator.set_threaded(threaded);
+        std::unique_ptr<trace_writer> recorder;
+        if (!recordTrace.empty()) {
+            recorder = std::make_unique<trace_writer>(recordTrace);
+            simulator.record_trace(recorder.get());
+        }
+        std::unique_ptr<stats_writer> stats;
+        if (!statsPath.empty()) {
+            stats = std::make_unique<stats_writer>(statsPath, statsInterval, statsUnit);
+            simulator.record_stats(stats.get());
+        }
+        if (replay) {
+            simulator.load_trace(argv[1]);
+        } else {
+            simulator.load_file(argv[1]);
+        }
+
+        std::string baseFilename = std::filesystem::path(argv[1]).stem().string();
+        std::string tag = functional.empty() ? pipeline_mode_name(mode) : "functional";
+        std::string outputBase = outputDir + "/" + baseFilename + "_" + tag;
+        if (outputPath.empty()) {
+            std::filesystem::create_directories(outputDir);
+            outputPath = outputBase + "_out." + diagram_extension(format);
+        }
+
+        std::ofstream outputFile;
+        if (outputPath != "-") {
+            outputFile.open(outputPath, std::ios::binary);
+            if (!outputFile.is_open()) {
+                std::cerr << "Error: Could not open output file " << outputPath << std::endl;
+                return 1;
+            }
+        }
+        std::ostream& out = outputPath == "-" ? std::cout : outputFile;
+        // The program's console device shares stdout unless the diagram is using it
+        std::ostream& console = outputPath == "-" ? std::cerr : std::cout;
+
+        if (!functional.empty()) {
+            // Functional run: num_cycles is an instruction budget, no pipeline timing
+            FunctionalSimulator sim(simulator.program());
+            sim.set_block_cache(functional == "blocks");
+            sim.set_console(&console);
+            sim.data_mem.data_memory = simulator.data_image();
+            for (const auto& image : memoryImages) {
+                load_memory_image(sim.data_mem.data_memory, parse_memory_image_spec(image));
+            }
+            if (!registerImage.empty()) {
+                load_register_image(sim.registers, registerImage);
+            }
+            auto start = std::chrono::steady_clock::now();
+            uint64_t budget = num_cycles.value_or(UINT64_MAX);
+            uint64_t retired = 0;
+            bool timedOut = false;
+            // Without a budget, a repeated state ends the run as in the pipelines
+            loop_detector loops;
+            bool looping = false;
+            // Run in slices so the watchdog and the loop detector get a look in. The
+            // state is only sampled between slices, so a loop of period P repeats
+            // within P / gcd(P, slice) samples; short slices keep that quick.
+            while (retired < budget) {
+                uint64_t slice = std::min<uint64_t>(budget - retired, 1 << 16);
+                uint64_t ran = sim.run(slice);
+                retired += ran;
+                if (ran < slice) {
+                    break;
+                }
+                if (!num_cycles && loops.observe(sim.state_hash(), retired)) {
+                    looping = true;
+                    break;
+                }
+                if (timeout > 0 && std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() >= timeout) {
+                    timedOut = true;
+                    break;
+                }
+            }
+            sim.flush_console();
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            sim.print_state(out);
+            std::cerr << retired << " instructions in " << seconds * 1e3 << " ms ("
+                      << (seconds > 0 ? retired / seconds / 1e6 : 0) << " MIPS)" << std::endl;
+            if (looping) {
+                std::cerr << "Stopped after " << retired << " instructions: infinite loop, the machine state repeated after "
+                          << loops.period << " instructions (pc " << sim.pc << ")" << std::endl;
+                return 125;
+            }
+            if (timedOut) {
+                std::cerr << "Stopped by the " << timeout << " s watchdog" << std::endl;
+                return 124;
+            }
+            return sim.halted() ? (int)sim.exit_code() : 0;
+        }
+
+        simulator.set_console(console);
+        for (const auto& image : memoryImages) {
+            simulator.load_memory_image(image);
+        }
+        if (!registerImage.empty()) {
+            simulator.load_register_image(registerImage);
+        }
+
+        if (profile) {
+            simulator.enable_profiler();
+        }
+        simulator.add_diagram_sink(out, format);
+
+        StopReason reason = StopReason::None;
+        if (debug) {
+            Debugger debugger(simulator.processor());
+            debugger.repl(std::cin, std::cerr, num_cycles.value_or(UINT64_MAX));
+        } else if (num_cycles && *num_cycles == 0) {
+            // run_limits reads a zero budget as no limit, so do not start at all
+            reason = StopReason::MaxCycles;
+        } else {
+            run_limits limits;
+            limits.max_cycles = num_cycles.value_or(0);
+            limits.max_seconds = timeout;
+            // An explicit budget asks for exactly that many cycles, looping or not
+            limits.detect_loops = !num_cycles;
+            reason = simulator.run_until(limits);
+        }
+
+        simulator.write_outputs();
+
+        if (recorder) {
+            recorder->close();
+            std::cerr << "Recorded " << recorder->records() << " instructions to " << recordTrace << std::endl;
+        }
+
+        if (stats) {
+            stats_snapshot last = simulator.processor().snapshot();
+            stats->close(&last);
+        }
+
+        if (storeBufferEntries > 0) {
+            simulator.processor().report_store_buffer(std::cerr);
+        }
+
+        if (storeSetWindow > 0) {
+            simulator.processor().report_store_sets(std::cerr);
+        }
+
+        if (wrongPath) {
+            simulator.processor().report_wrong_path(std::cerr);
+        }
+
+        if (energy) {
+            simulator.processor().report_energy(std::cerr, energyTable);
+        }
+
+        if (simulator.processor().roi_marked()) {
+            simulator.processor().report_roi(std::cerr);
+        }
+
+#ifdef PROCSIM_HOST_PROFILE
+        simulator.processor().report_host_profile(std::cerr);
+#endif
+
+        if (profile) {
+            std::ofstream report(outputBase + "_profile.txt");
+            simulator.profile().report(report);
+            std::ofstream folded(outputBase + "_profile.folded");
+            simulator.profile().folded(folded);
+        }
+
+        // A program that wrote the exit register passes its code on
+        if (simulator.halted()) {
+            return (int)simulator.exit_code();
+        }
+        if (reason == StopReason::Looping) {
+            std::cerr << "Stopped after " << simulator.cycles() << " cycles: infinite loop, the machine state repeated after "
+                      << simulator.loop_period() << " cycles (pc " << simulator.pc() << ")" << std::endl;
+            return 125;
+        }
+        if (reason == StopReason::TimeLimit) {
+            std::cerr << "Stopped after " << simulator.cycles() << " cycles by the " << timeout << " s watchdog" << std::endl;
+            return 124;
+        }
+
+    } catch (const std::exception& e) {
+        std::cerr << "Error during simulation: " << e.what() << std::endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,100 @@
+#ifndef MMIO_HPP
+#define MMIO_HPP
+
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+// Memory-mapped I/O occupies the top 256 bytes of the address space, so a
+// program reaches it with x0 as the base register, e.g. "sw x5, -256(x0)".
+// data_memory sends an access here only when addr >= mmio_base, so ordinary
+// loads and stores pay a single compare.
+static const uint64_t mmio_base = 0xFFFFFFFFFFFFFF00ull;
+static const size_t mmio_slots = 32; // one per 8-byte register
+
+// Offsets of the standard devices
+enum mmio_register : uint64_t
+{
+    MMIO_CONSOLE = 0x00, // write: low byte is appended to the console
+    MMIO_EXIT = 0x08,    // write: stop the run with this exit code
+    MMIO_CYCLE = 0x10    // read: cycles completed so far
+};
+
+struct mmio_bus
+{
+    struct device
+    {
+        function<int64_t()> read;
+        function<void(int64_t)> write;
+    };
+
+    // Unmapped slots read as 0 and ignore writes
+    device slots[mmio_slots];
+
+    static size_t slot(uint64_t address)
+    {
+        return ((address - mmio_base) >> 3) % mmio_slots;
+    }
+
+    void map(uint64_t offset, function<int64_t()> read, function<void(int64_t)> write)
+    {
+        slots[slot(mmio_base + offset)] = {move(read), move(write)};
+    }
+
+    int64_t read(uint64_t address) const
+    {
+        const device &d = slots[slot(address)];
+        return d.read ? d.read() : 0;
+    }
+
+    void write(uint64_t address, int64_t value)
+    {
+        device &d = slots[slot(address)];
+        if (d.write)
+            d.write(value);
+    }
+};
+
+// Console, exit and cycle counter, shared by the pipeline and functional engines
+struct standard_devices
+{
+    ostream *console = nullptr; // output is dropped while unset
+    string console_buffer;
+    bool halted = false;
+    int64_t exit_code = 0;
+    function<uint64_t()> cycle_source;
+
+    void attach(mmio_bus &bus)
+    {
+        bus.map(MMIO_CONSOLE, nullptr, [this](int64_t value) {
+            console_buffer.push_back((char)value);
+            if (console_buffer.size() >= 4096)
+                flush_console();
+        });
+        bus.map(MMIO_EXIT, nullptr, [this](int64_t value) {
+            halted = true;
+            exit_code = value;
+            flush_console();
+        });
+        bus.map(MMIO_CYCLE, [this]() { return cycle_source ? (int64_t)cycle_source() : 0; }, nullptr);
+    }
+
+    void flush_console()
+    {
+        if (console && !console_buffer.empty())
+            console->write(console_buffer.data(), console_buffer.size()).flush();
+        console_buffer.clear();
+    }
+
+    void reset()
+    {
+        console_buffer.clear();
+        halted = false;
+        exit_code = 0;
+    }
+};
+
+#endif // MMIO_HPP
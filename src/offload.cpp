@@ -0,0 +1,69 @@
+#include "offload.hpp"
+
+// Events in flight; at 72 bytes each the ring stays within the L2 cache
+static const size_t ring_capacity = 1 << 14;
+// Empty polls before the worker sleeps; a running simulation pushes well within this
+static const int idle_spins = 1 << 12;
+
+cycle_offload::cycle_offload(sparse_diagram &target) : ring(ring_capacity), diagram(target)
+{
+    worker = thread(&cycle_offload::run, this);
+}
+
+cycle_offload::~cycle_offload()
+{
+    drain();
+    stopping.store(true, memory_order_release);
+    wake_worker();
+    worker.join();
+}
+
+void cycle_offload::wake_worker()
+{
+    lock_guard<mutex> guard(lock);
+    wake.notify_one();
+}
+
+void cycle_offload::run()
+{
+    cycle_event event;
+    int idle = 0;
+    while (true)
+    {
+        if (!ring.try_pop(event))
+        {
+            if (stopping.load(memory_order_acquire))
+                return;
+            if (++idle < idle_spins)
+            {
+                this_thread::yield();
+                continue;
+            }
+            unique_lock<mutex> guard(lock);
+            sleeping.store(true, memory_order_relaxed);
+            atomic_thread_fence(memory_order_seq_cst);
+            wake.wait(guard, [this]() { return !ring.empty() || stopping.load(memory_order_acquire); });
+            sleeping.store(false, memory_order_relaxed);
+            idle = 0;
+            continue;
+        }
+        idle = 0;
+        if (event.kinds & cycle_event::RETIRE)
+            recorder->append(event.pc, event.instruction, event.address);
+        if (event.kinds & cycle_event::DIAGRAM)
+            record_cycle(diagram, event);
+        applied.store(applied.load(memory_order_relaxed) + 1, memory_order_release);
+    }
+}
+
+void cycle_offload::drain()
+{
+    while (applied.load(memory_order_acquire) != pushed)
+        this_thread::yield();
+}
+
+void cycle_offload::set_recorder(trace_writer *writer)
+{
+    drain();
+    recorder = writer;
+}
@@ -0,0 +1,86 @@
+#ifndef OFFLOAD_HPP
+#define OFFLOAD_HPP
+
+#include "diagram.hpp"
+#include "spsc_ring.hpp"
+#include "trace.hpp"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+// What the simulation thread produces each cycle for the diagram and the trace
+// recorder. Rows are instr_index per stage, SIZE_MAX for an empty stage.
+struct cycle_event
+{
+    enum : uint8_t
+    {
+        DIAGRAM = 1, // rows hold this cycle's diagram column
+        RETIRE = 2   // pc, instruction and address describe a committed instruction
+    };
+
+    uint64_t cycle;
+    uint64_t rows[5]; // IF, ID, EX, MEM, WB
+    uint64_t pc;
+    uint64_t address;
+    uint32_t instruction;
+    uint8_t kinds;
+};
+
+// Diagram column for one cycle; the same code runs on either thread
+inline void record_cycle(sparse_diagram &diagram, const cycle_event &event)
+{
+    for (int s = 0; s < 5; s++)
+        if (event.rows[s] != SIZE_MAX)
+            diagram.record(event.cycle, event.rows[s], 1 << s);
+    diagram.record_frontier(event.cycle, event.rows[0]);
+}
+
+// Threaded runs: the diagram update and trace writing, which cost more host
+// time than the pipeline itself, move to a worker thread fed through a
+// lock-free ring. Events are applied in cycle order, so the diagram and trace
+// come out byte for byte as in a single-threaded run. The simulation thread
+// must drain() before anything reads the diagram or touches the recorder.
+// An idle worker spins briefly, then sleeps until push() or shutdown wakes it,
+// so a paused run (the debugger waiting on stdin) costs no CPU.
+class cycle_offload
+{
+    spsc_ring<cycle_event> ring;
+    sparse_diagram &diagram;
+    trace_writer *recorder = nullptr;
+    uint64_t pushed = 0;
+    atomic<uint64_t> applied{0};
+    atomic<bool> stopping{false};
+    // Set by the worker before it sleeps on wake; push() takes lock only then
+    atomic<bool> sleeping{false};
+    mutex lock;
+    condition_variable wake;
+    thread worker;
+
+    void wake_worker();
+
+    void run();
+
+public:
+    explicit cycle_offload(sparse_diagram &target);
+    ~cycle_offload();
+    cycle_offload(const cycle_offload &) = delete;
+    cycle_offload &operator=(const cycle_offload &) = delete;
+
+    void push(const cycle_event &event)
+    {
+        while (!ring.try_push(event))
+            this_thread::yield();
+        pushed++;
+        // Orders the push before the check, against the worker's store of sleeping before its empty check
+        atomic_thread_fence(memory_order_seq_cst);
+        if (sleeping.load(memory_order_relaxed))
+            wake_worker();
+    }
+
+    // Wait until the worker has applied everything pushed so far
+    void drain();
+    // Drains first; the worker appends committed instructions to writer from then on
+    void set_recorder(trace_writer *writer);
+};
+
+#endif // OFFLOAD_HPP
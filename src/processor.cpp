@@ -1,22 +1,17 @@
 #include "processor.hpp"
+#include "assembler.hpp"
 #include <iostream>
 #include <iomanip>
 #include <fstream>
 #include <sstream>
 #include <bitset>
+#include <stdexcept>
 
-void Processor::load_instructions(const string &filename)
+void Processor::load_instructions(istream &input)
 {
-    std::ifstream file(filename);
-    if (!file.is_open())
-    {
-        cerr << "Error: Could not open file " << filename << endl;
-        exit(1);
-    }
-
     std::string line;
     uint32_t instruction = 0;
-    while (std::getline(file, line))
+    while (std::getline(input, line))
     {
         // Skip empty lines and comments
         if (line.empty() || line[0] == '#')
@@ -27,99 +22,247 @@ void Processor::load_instructions(const string &filename)
         std::stringstream ss(line);
         ss >> std::hex >> instruction;
 
+        // The assembly text is not kept; diagram rows are labelled by disassembling the word
         instr_mem.instructions.push_back(instruction);
-        // Save the full assembly string (first column in diagram)
-        instruction_strings.push_back(line);
-        // Initialize the corresponding pipeline diagram row with the instruction string.
-        pipeline_states.push_back(line);
     }
-
-    file.close();
 }
 
 
+Processor::Processor()
+{
+    data_mem.mmio = &bus;
+    devices.cycle_source = [this]() { return cycle_count; };
+    devices.attach(bus);
+}
+
 void Processor::load_program(const string &filename)
 {
+    std::ifstream file(filename);
+    if (!file.is_open())
+    {
+        throw runtime_error("Could not open file " + filename);
+    }
+    load_program(file);
+}
+
+void Processor::load_program(istream &input)
+{
+    sync();
     // Reset processor state
     pc.instruction_address = 0;
+    trace = nullptr;
+    data_mem.mmio = &bus;
+    data_mem.timing_only = false;
     cycle_count = 0;
+    events = pipeline_counters();
+    edge_counters = pipeline_counters();
+    wrong_path = wrong_path_counters();
+    roi = region_of_interest();
+    activity = activity_counters();
+    reg_file.reads = reg_file.writes = 0;
 
     // Clear pipeline registers
     IF_ID = IF_ID_register_file();
     ID_EX = ID_EX_register_file();
     EX_MEM = EX_MEM_register_file();
     MEM_WB = MEM_WB_register_file();
+    fetched = false;
 
     // // Clear tracking data
-    instruction_strings.clear();
-    pipeline_states.clear();
+    instr_mem.instructions.clear();
+
+    // Load instructions, assembling them first unless the file is a hex listing
+    program_data.clear();
+    ostringstream buffer;
+    buffer << input.rdbuf();
+    const string text = buffer.str();
+    if (is_assembly_source(text))
+    {
+        assembled_program assembled = assemble(text);
+        instr_mem.instructions = move(assembled.instructions);
+        program_data = move(assembled.data);
+        for (const auto &cell : program_data)
+            data_mem.data_memory[cell.first] = cell.second;
+    }
+    else
+    {
+        istringstream listing(text);
+        load_instructions(listing);
+    }
+    diagram.reset(instr_mem.instructions);
+    timers.reset();
+    devices.reset();
+    store_buf.configure(store_buf.ring.size(), store_buf.drain_interval);
+    store_sets.configure(store_sets.window);
+}
 
-    // Load instructions
-    load_instructions(filename);
+void Processor::load_trace(instruction_trace &recorded)
+{
+    istringstream no_program;
+    load_program(no_program);
+    trace = &recorded;
+    trace_next = 0;
+    // Addresses come from the trace but the stored values are made up, so
+    // devices stay unmapped and memory keeps nothing
+    data_mem.mmio = nullptr;
+    data_mem.timing_only = true;
 }
 
-void Processor::generate_control_signals(bool stall)
+size_t Processor::load_memory_image(const memory_image_spec &spec)
 {
-    uint32_t opcode = IF_ID.instruction & 0x7F;
-    uint32_t funct3 = (IF_ID.instruction >> 12) & 0x7;
-    uint32_t funct7 = (IF_ID.instruction >> 25) & 0x7F;
+    return ::load_memory_image(data_mem.data_memory, spec);
+}
 
-    // Default control signals
-    control = ControlSignals();
+void Processor::load_register_image(const string &path)
+{
+    ::load_register_image(reg_file.registers, path);
+}
 
-    if (!stall)
-    {
-        switch (opcode)
-        {
-        case 0x33: // R-type instructions -> 0110011
-            control.regWrite = true;
-            control.aluOp = 2; // R-type ALU operations
-            break;
+ControlSignals Processor::decode_control(uint32_t instruction)
+{
+    uint32_t opcode = instruction & 0x7F;
 
-        case 0x13: // I-type ALU instructions -> 0010011
-            control.regWrite = true;
-            control.aluSrc = true;
-            control.aluOp = 2; // I-type ALU operations
-            break;
+    ControlSignals control;
 
-            // jalr is a I-type isntruction with different opcode
+    switch (opcode)
+    {
+    case 0x33: // R-type instructions -> 0110011
+        control.regWrite = true;
+        control.aluOp = 2; // R-type ALU operations
+        break;
+
+    case 0x13: // I-type ALU instructions -> 0010011
+        control.regWrite = true;
+        control.aluSrc = true;
+        control.aluOp = 2; // I-type ALU operations
+        break;
+
+        // jalr is a I-type isntruction with different opcode
+
+    case 0x03: // Load instructions -> 0000011
+        control.memRead = true;
+        control.regWrite = true;
+        control.aluSrc = true;
+        control.memToReg = true;
+        break;
+
+    case 0x23: // Store instructions -> 0100011
+        control.memWrite = true;
+        control.aluSrc = true;
+        break;
+
+    case 0x63: // Branch instructions -> 1100111
+        control.branch = true;
+        control.aluOp = 1; // Branch comparison
+        break;
+
+    case 0x73: // csrrw/csrrs/csrrc and immediate forms; ecall and ebreak do nothing
+        control.regWrite = is_csr_instruction(instruction);
+        break;
+
+    case 0x67:      // jalr
+        control.regWrite = true;
+        control.aluOp = 2;
+    
+    case 0x6F:
+        control.regWrite = true;
+        control.aluOp = 2;
+    default:
+        // Unknown opcode - NOP
+        break;
+    }
+    return control;
+}
 
-        case 0x03: // Load instructions -> 0000011
-            control.memRead = true;
-            control.regWrite = true;
-            control.aluSrc = true;
-            control.memToReg = true;
-            break;
+bool Processor::fetch_instruction()
+{
+    if (trace)
+        return fetch_traced();
 
-        case 0x23: // Store instructions -> 0100011
-            control.memWrite = true;
-            control.aluSrc = true;
-            break;
+    // Check if we've reached the end of the instruction memory
+    if (pc.instruction_address / 4 >= instr_mem.instructions.size())
+    {
+        next.IF_ID.instr_index = SIZE_MAX;
+        next.IF_ID.instruction = 0; // Clear the instruction to indicate no more instructions
+        return false;
+    }
+    instr_mem.address = pc.instruction_address;
+    instr_mem.fetch();
+    next.IF_ID.instruction = instr_mem.instruction;
+    next.IF_ID.program_counter = pc.instruction_address;
 
-        case 0x63: // Branch instructions -> 1100111
-            control.branch = true;
-            control.aluOp = 1; // Branch comparison
-            break;
+    if (IF_ID.flush)
+    {
+        next.IF_ID.instr_index = pc.instruction_address / 4;
+    }
+    else
+    {
+        if (IF_ID.instr_index != instr_mem.instructions.size() - 1 && !pc_handler.stall)
+            next.IF_ID.instr_index = IF_ID.instr_index + 1;
+    }
+    return true;
+}
 
-        case 0x67:      // jalr
-            control.regWrite = true;
-            control.aluOp = 2;
-        
-        case 0x6F:
-            control.regWrite = true;
-            control.aluOp = 2;
-        default:
-            // Unknown opcode - NOP
-            break;
-        }
+// The trace holds only the committed path. In the slot the pipeline would fill
+// from the wrong path after a taken branch or jump, fetch an empty placeholder;
+// the flush squashes it and the target is simply the next record.
+bool Processor::fetch_traced()
+{
+    bool holding = IF_ID.instr_index != SIZE_MAX;
+    if (IF_ID.flush)
+    {
+        // A squashed record has to come through again
+        if (holding)
+            trace_next = IF_ID.instr_index;
+    }
+    else if (pc_handler.stall)
+    {
+        return holding || trace_next < trace->size();
+    }
+    else if (holding && (*trace)[IF_ID.instr_index].taken())
+    {
+        next.IF_ID.instr_index = SIZE_MAX;
+        next.IF_ID.instruction = 0;
+        return true;
     }
+
+    if (trace_next >= trace->size())
+    {
+        next.IF_ID.instr_index = SIZE_MAX;
+        next.IF_ID.instruction = 0;
+        return false;
+    }
+    const trace_record &record = (*trace)[trace_next];
+    next.IF_ID.instruction = record.instruction;
+    next.IF_ID.program_counter = pc.instruction_address = record.pc;
+    next.IF_ID.instr_index = trace_next++;
+
+    // Nothing further back than the oldest in-flight instruction is read again
+    if (trace_next > 64)
+        trace->release_before(trace_next - 64);
+    return true;
 }
 
-void Processor::generate_alu_ops(ALU::Operation &operation)
+bool Processor::branch_equal(bool computed) const
+{
+    if (!trace || IF_ID.instr_index == SIZE_MAX)
+        return computed;
+    bool taken = (*trace)[IF_ID.instr_index].taken();
+    bool bne = ((IF_ID.instruction >> 12) & 0x7) == 0x1;
+    return bne ? !taken : taken;
+}
+
+void Processor::generate_control_signals(bool stall)
+{
+    // A stalled instruction gets the default (all off) control signals
+    control = stall ? ControlSignals() : decode_control(IF_ID.instruction);
+}
+
+ALU::Operation Processor::decode_alu_op(uint32_t instruction, uint8_t aluOp)
 {
-    uint32_t funct3 = (ID_EX.instruction >> 12) & 0x7;
-    uint32_t funct7 = (ID_EX.instruction >> 25) & 0x7F;
-    uint8_t aluOp = ID_EX.aluOp;
+    uint32_t funct3 = (instruction >> 12) & 0x7;
+    uint32_t funct7 = (instruction >> 25) & 0x7F;
+    ALU::Operation operation = ALU::Operation::ADD;
 
     // Based on aluOp
     if (aluOp == 0)
@@ -180,6 +323,12 @@ void Processor::generate_alu_ops(ALU::Operation &operation)
             break;
         }
     }
+    return operation;
+}
+
+void Processor::generate_alu_ops(ALU::Operation &operation)
+{
+    operation = decode_alu_op(ID_EX.instruction, ID_EX.aluOp);
 }
 
 void Processor::memory_access()
@@ -191,132 +340,380 @@ void Processor::memory_access()
     data_mem.memWrite = EX_MEM.memWrite;
 
     // Access memory if needed
-
-    data_mem.read();
-    MEM_WB.read_data = data_mem.r_data;
-
-    // if (EX_MEM.memWrite)
-
-    data_mem.write();
+    activity.count[ACT_MEMORY_READ] += data_mem.memRead;
+    activity.count[ACT_MEMORY_WRITE] += data_mem.memWrite;
+
+    int64_t forwarded;
+    if (data_mem.memRead && store_buf.enabled() && store_buf.forward(data_mem.addr, forwarded))
+        data_mem.r_data = forwarded;
+    else
+        HOST_TIMED(timers, HOST_DATA_MEMORY, data_mem.read());
+    next.MEM_WB.read_data = data_mem.r_data;
+
+    // Buffered stores reach memory later, in store_buffer::tick()
+    if (data_mem.memWrite && store_buf.enabled() && store_buffer::buffered(data_mem.addr))
+        store_buf.push(data_mem.addr, data_mem.w_data);
+    else
+        HOST_TIMED(timers, HOST_DATA_MEMORY, data_mem.write());
 
     // Forward ALU result
-    MEM_WB.alu_result = EX_MEM.alu_result;
+    next.MEM_WB.alu_result = EX_MEM.alu_result;
 
     // Forward control signals
-    MEM_WB.regWrite = EX_MEM.regWrite; // regWrite
-    MEM_WB.memToReg = EX_MEM.memToReg; // memToReg
+    next.MEM_WB.regWrite = EX_MEM.regWrite; // regWrite
+    next.MEM_WB.memToReg = EX_MEM.memToReg; // memToReg
 
     // Forward register destination
-    MEM_WB.EX_MEM_RegisterRD = EX_MEM.ID_EX_RegisterRD;
+    next.MEM_WB.EX_MEM_RegisterRD = EX_MEM.ID_EX_RegisterRD;
 
-    MEM_WB.instr_index = EX_MEM.instr_index;
+    next.MEM_WB.instr_index = EX_MEM.instr_index;
 }
 
 void Processor::write_back()
 {
-    // Write to register file if needed
-    reg_file.regWrite = MEM_WB.regWrite;
-
-    mux_wb = MUX_WB();
-
     mux_wb.mem_to_reg = MEM_WB.memToReg;
     mux_wb.mem_value = MEM_WB.read_data;
     mux_wb.alu_value = MEM_WB.alu_result;
 
     mux_wb.handle();
     
-    reg_file.w_data = mux_wb.output;
-    reg_file.rd = MEM_WB.EX_MEM_RegisterRD;
-    reg_file.write();
+    // Write to register file if needed
+    reg_file.set_write(0, MEM_WB.regWrite, MEM_WB.EX_MEM_RegisterRD, mux_wb.output);
+    HOST_TIMED(timers, HOST_REGISTER_FILE, reg_file.write());
     
     data_mem.wb_index = MEM_WB.instr_index;
+    if (MEM_WB.instr_index == SIZE_MAX)
+        return;
+    events.instructions++;
+
+    if (recorder || store_sets.enabled())
+    {
+        size_t i = MEM_WB.instr_index;
+        uint64_t at = trace ? (*trace)[i].pc : i * 4;
+        uint32_t instruction = trace ? (*trace)[i].instruction : instr_mem.instructions[i];
+        // alu_result is the effective address of a load or store
+        if (recorder && offload)
+        {
+            event.pc = at;
+            event.instruction = instruction;
+            event.address = MEM_WB.alu_result;
+            event.kinds |= cycle_event::RETIRE;
+        }
+        else if (recorder)
+            recorder->append(at, instruction, MEM_WB.alu_result);
+        if (store_sets.enabled())
+            store_sets.retire(at, instruction, MEM_WB.alu_result);
+    }
 }
 
 // I have not made use of the MUX_WB here.
 
 void Processor::update_pipeline_diagram()
 {
-    // Create a temporary vector to track stages for each instruction
-    vector<vector<string>> instructionStages(pipeline_states.size());
+    // Rows are per static instruction, which a trace does not have; only the cycle count is kept
+    if (trace || !diagram_recording)
+    {
+        diagram.cycles = cycle_count;
+    }
+    else
+    {
+        // The stage each in-flight instruction occupies this cycle
+        event.cycle = cycle_count;
+        event.rows[0] = IF_ID.instr_index;
+        event.rows[1] = ID_EX.instruction != 0 ? ID_EX.instr_index : SIZE_MAX;
+        event.rows[2] = EX_MEM.instr_index;
+        event.rows[3] = MEM_WB.instr_index;
+        event.rows[4] = data_mem.wb_index;
+        event.kinds |= cycle_event::DIAGRAM;
+    }
 
-    // Check and track stages for each instruction
-    if (IF_ID.instr_index != SIZE_MAX)
-        instructionStages[IF_ID.instr_index].push_back(" IF  ");
-    
-    if (ID_EX.instruction != 0 && ID_EX.instr_index != SIZE_MAX)
-        instructionStages[ID_EX.instr_index].push_back(" ID  ");
-    
-    if (EX_MEM.instr_index != SIZE_MAX)
-        instructionStages[EX_MEM.instr_index].push_back(" EX  ");
-    
-    if (MEM_WB.instr_index != SIZE_MAX)
-        instructionStages[MEM_WB.instr_index].push_back(" MEM ");
-    
-    if (data_mem.wb_index != SIZE_MAX)
-        instructionStages[data_mem.wb_index].push_back(" WB  ");
-    
-    // Update pipeline states
-    for (size_t i = 0; i < pipeline_states.size(); i++)
+    if (offload && event.kinds)
+        offload->push(event);
+    else if (event.kinds)
+        record_cycle(diagram, event);
+    event.kinds = 0;
+}
+
+
+void Processor::record_trace(trace_writer *writer)
+{
+    if (offload)
+        offload->set_recorder(writer);
+    recorder = writer;
+}
+
+void Processor::set_threaded(bool enabled)
+{
+    if (enabled == (offload != nullptr))
+        return;
+    sync();
+    offload = enabled ? make_unique<cycle_offload>(diagram) : nullptr;
+    if (offload)
+        offload->set_recorder(recorder);
+}
+
+void Processor::sync() const
+{
+    if (offload)
+        offload->drain();
+}
+
+void Processor::print_pipeline_diagram() const
+{
+    write_diagram(std::cout, diagram_format::text);
+}
+
+int64_t Processor::memory_value(uint64_t address) const
+{
+    int64_t pending;
+    if (store_buf.peek(address, pending))
+        return pending;
+    auto it = data_mem.data_memory.find(address);
+    return it == data_mem.data_memory.end() ? 0 : it->second;
+}
+
+void Processor::write_diagram(ostream &out, diagram_format format) const
+{
+    sync();
+    if (!diagram_recording)
     {
-        string stage;
-        if (!instructionStages[i].empty())
+        sparse_diagram cycles_only;
+        cycles_only.cycles = cycle_count;
+        cycles_only.write(out, format);
+        return;
+    }
+    diagram.write(out, format);
+}
+
+bool Processor::pipeline_drained() const
+{
+    bool fetched_all = trace ? trace_next >= trace->size() : pc.instruction_address >= instr_mem.instructions.size();
+    return fetched_all &&
+           IF_ID.instr_index == SIZE_MAX && ID_EX.instr_index == SIZE_MAX &&
+           EX_MEM.instr_index == SIZE_MAX && MEM_WB.instr_index == SIZE_MAX &&
+           store_buf.empty();
+}
+
+uint64_t Processor::state_hash() const
+{
+    // Registers and memory keep their own incremental hashes
+    const uint64_t latches[] = {
+        pc.instruction_address, (uint64_t)pc_handler.currPC, (uint64_t)pc_handler.branch_jump_PC,
+        (uint64_t)pc_handler.branch_taken | (uint64_t)pc_handler.stall << 1 | (uint64_t)IF_ID.flush << 2,
+        IF_ID.instruction, IF_ID.program_counter, IF_ID.instr_index,
+        ID_EX.instruction, ID_EX.instr_index, (uint64_t)ID_EX.reg1_data, (uint64_t)ID_EX.reg2_data,
+        (uint64_t)ID_EX.tempr1_data, (uint64_t)ID_EX.immediate,
+        EX_MEM.instr_index, (uint64_t)EX_MEM.alu_result, (uint64_t)EX_MEM.write_data,
+        MEM_WB.instr_index, (uint64_t)MEM_WB.alu_result, (uint64_t)MEM_WB.read_data,
+        trace_next, roi.value};
+
+    uint64_t hash = reg_file.state_hash ^ (data_mem.state_hash * 0x9E3779B97F4A7C15ull);
+    for (size_t i = 0; i < sizeof(latches) / sizeof(latches[0]); i++)
+        hash ^= state_mix(~(uint64_t)i, (int64_t)latches[i]);
+    return hash;
+}
+
+void Processor::step()
+{
+    edge_counters = counters();
+
+    // A replayed load or store goes where the trace says, whatever the registers held
+    if (trace && EX_MEM.instr_index != SIZE_MAX && (EX_MEM.memRead || EX_MEM.memWrite))
+        EX_MEM.alu_result = (*trace)[EX_MEM.instr_index].address;
+
+    bool frozen = false;
+    if (store_buf.enabled())
+    {
+        store_buf.tick(data_mem);
+        // A store that finds every entry busy holds the whole pipeline; WB gets a bubble
+        if (EX_MEM.memWrite && !store_buf.accepts(EX_MEM.alu_result))
         {
-            // If multiple stages, join them with '/'
-            if (instructionStages[i].size() > 1)
-            {
-                stage = instructionStages[i][0] + "/" + instructionStages[i][1];
-            }
-            else
-            {
-                stage = instructionStages[i][0];
-            }
+            store_buf.stats.full_stalls++;
+            data_mem.wb_index = SIZE_MAX;
+            events.stall_cycles++;
+            frozen = true;
         }
-        else
+    }
+
+    if (!frozen)
+    {
+        // Fields a stage leaves alone keep their value across the edge
+        next = {IF_ID, ID_EX, EX_MEM, MEM_WB};
+
+        // Stages see only the current registers, so program order works as well as any
+        HOST_TIMED(timers, HOST_FETCH, fetch());
+        HOST_TIMED(timers, HOST_DECODE, decode());
+        HOST_TIMED(timers, HOST_EXECUTE, execute());
+        HOST_TIMED(timers, HOST_MEMORY, memory_access());
+        HOST_TIMED(timers, HOST_WRITE_BACK, write_back());
+        activity.count[ACT_FETCH] += fetched;
+
+        clock_edge();
+        if (fetched)
         {
-            // For finished or not yet fetched instructions
-            if (i < IF_ID.instr_index)
-                stage = "  -  ";
-            else
-                stage = "     ";
+            update_scoreboard();
+            resolve_hazards();
+            events.stall_cycles += pc_handler.stall;
+            if (IF_ID.flush)
+                squash_wrong_path();
         }
-        
-        // Append the field using semicolon as delimiter
-        pipeline_states[i] += ";" + stage;
     }
+
+    // Update cycle count and pipeline diagram
+    cycle_count++;
+    if (stats && stats->due(cycle_count, events.instructions))
+        stats->append(snapshot());
+    HOST_TIMED(timers, HOST_DIAGRAM, update_pipeline_diagram());
+
+    if (profiler)
+        HOST_TIMED(timers, HOST_PROFILER, profiler->sample(*this));
 }
 
+void Processor::clock_edge()
+{
+    IF_ID = next.IF_ID;
+    ID_EX = next.ID_EX;
+    EX_MEM = next.EX_MEM;
+    MEM_WB = next.MEM_WB;
+}
 
-void Processor::print_pipeline_diagram() const
+void Processor::update_scoreboard()
+{
+    register_scoreboard &s = reg_file.scoreboard;
+    s.loading = dest_mask(ID_EX.IF_ID_Register_RD, ID_EX.memRead);
+    s.busy = dest_mask(ID_EX.IF_ID_Register_RD, ID_EX.regWrite || ID_EX.memRead) |
+             dest_mask(EX_MEM.ID_EX_RegisterRD, EX_MEM.regWrite || EX_MEM.memRead);
+    s.writing = dest_mask(MEM_WB.EX_MEM_RegisterRD, MEM_WB.regWrite);
+}
+
+pipeline_counters Processor::counters() const
+{
+    pipeline_counters now = events;
+    now.cycles = cycle_count;
+    return now;
+}
+
+// The instruction fetched behind a taken branch or jump is in IF_ID now and
+// becomes a bubble in ID. With no caches or predictor to disturb, its work is
+// only counted, by kind. A replayed trace fetches empty placeholders here.
+void Processor::squash_wrong_path()
+{
+    events.flushes++;
+    if (IF_ID.instr_index == SIZE_MAX)
+        return;
+    events.wrong_path++;
+    switch (IF_ID.instruction & 0x7F)
+    {
+    case 0x03:
+        wrong_path.loads++;
+        break;
+    case 0x23:
+        wrong_path.stores++;
+        break;
+    case 0x63:
+    case 0x67:
+    case 0x6F:
+        wrong_path.control++;
+        break;
+    default:
+        wrong_path.other++;
+    }
+}
+
+void Processor::report_wrong_path(ostream &out) const
 {
-    for (const auto &state : pipeline_states)
+    out << "Wrong path: " << events.flushes << " fetch slots squashed, " << events.wrong_path << " instructions\n"
+        << "  loads " << wrong_path.loads << ", stores " << wrong_path.stores << ", branches and jumps "
+        << wrong_path.control << ", other " << wrong_path.other << "\n";
+}
+
+activity_counters Processor::activity_counts() const
+{
+    activity_counters a = activity;
+    a.count[ACT_REGISTER_READ] = reg_file.reads;
+    a.count[ACT_REGISTER_WRITE] = reg_file.writes;
+    a.count[ACT_CLOCK] = cycle_count;
+    return a;
+}
+
+stats_snapshot Processor::snapshot() const
+{
+    return {cycle_count, events.instructions, events.stall_cycles, events.flushes, events.wrong_path,
+            (uint64_t)data_mem.data_memory.size(), roi.value != 0};
+}
+
+int64_t Processor::csr_access(uint32_t instruction, int64_t rs1_value)
+{
+    uint64_t old_value = 0;
+    switch (csr_number(instruction))
     {
-        std::cout << state << std::endl;
+    case CSR_CYCLE:
+    case CSR_TIME:
+        old_value = edge_counters.cycles;
+        break;
+    case CSR_INSTRET:
+        old_value = edge_counters.instructions;
+        break;
+    case CSR_ROI:
+        old_value = roi.value;
+        if (csr_writes(instruction))
+            roi.write(csr_new_value(instruction, old_value, rs1_value), edge_counters);
+        break;
     }
-    std::cout << "\nTotal cycles: " << cycle_count << std::endl;
+    // Unknown CSRs read as zero; writes to them and to the counters are dropped
+    return (int64_t)old_value;
+}
+
+void Processor::report_store_buffer(ostream &out) const
+{
+    const store_buffer::counters &c = store_buf.stats;
+    out << "Store buffer: " << store_buf.ring.size() << " entries x " << store_buffer::line_bytes
+        << " bytes, drain every " << store_buf.drain_interval << " cycle(s)\n"
+        << "  stores " << c.stores << ", coalesced " << c.coalesced << ", drained entries " << c.drained << "\n"
+        << "  forwarded loads " << c.forwarded_loads << ", full stalls " << c.full_stalls << "\n"
+        << "  occupancy avg " << (c.cycles ? (double)c.occupancy_sum / c.cycles : 0.0)
+        << ", max " << c.max_occupancy << "\n";
+}
+
+void Processor::report_store_sets(ostream &out) const
+{
+    const store_set_predictor::counters &c = store_sets.stats;
+    out << "Store sets: loads may pass the stores among the previous " << store_sets.window << " instructions\n"
+        << "  loads " << c.loads << " (" << c.exposed_loads << " behind an older store), stores " << c.stores << "\n"
+        << "  hoisted " << c.hoisted << ", synchronized " << c.synchronized << ", false dependences "
+        << c.false_dependences << "\n"
+        << "  violations " << c.violations << ", replays " << c.replays << " (" << c.replayed_instructions
+        << " instructions)\n";
+}
+
+void Processor::report_host_profile(ostream &out) const
+{
+#ifdef PROCSIM_HOST_PROFILE
+    timers.report(out, cycle_count);
+#else
+    out << "Host profiling is compiled out; rebuild with HOST_PROFILE=1\n";
+#endif
+}
+
+void Processor::attach_profiler(Profiler *p)
+{
+    if (p && trace)
+        throw runtime_error("the profiler needs a program, not a trace");
+    profiler = p;
+    if (profiler)
+        profiler->reset(instr_mem.instructions);
 }
 
-void Processor::run_simulation(int max_cycles)
+void Processor::run_simulation(uint64_t max_cycles)
 {
-    for (int i = 0; i < max_cycles; i++)
+    for (uint64_t i = 0; i < max_cycles; i++)
     {
         // Exit if we've processed all instructions and the pipeline is empty
-        if (pc.instruction_address >= instr_mem.instructions.size() &&
-            IF_ID.instr_index == SIZE_MAX && ID_EX.instr_index == SIZE_MAX && 
-            EX_MEM.instr_index == SIZE_MAX && MEM_WB.instr_index == SIZE_MAX)
+        if (finished())
         {
             break;
         }
 
-        // Execute pipeline stages in reverse order (to avoid data overwriting)
-        write_back();
-        memory_access();
-        execute();
-        decode();
-        fetch();
-        
-
-        // Update cycle count and pipeline diagram
-        cycle_count++;
-        update_pipeline_diagram();
+        step();
     }
 }
@@ -2,65 +2,254 @@
 #define PROCESSOR_HPP
 
 #include "ds.hpp"
+#include "diagram.hpp"
+#include "profiler.hpp"
+#include "host_timer.hpp"
+#include "state_image.hpp"
+#include "trace.hpp"
+#include "csr.hpp"
+#include "stats.hpp"
+#include "offload.hpp"
+#include "energy.hpp"
+#include <memory>
 #include <string>
 #include <fstream>
 #include <vector>
 
+// Why a run (or a debugger command) stopped
+enum class StopReason
+{
+    None,
+    MaxCycles,
+    Drained,
+    Halted,
+    Looping,
+    TimeLimit,
+    Breakpoint,
+    RegisterWatch,
+    MemoryWatch
+};
+
 class Processor
 {
-protected:
-    // Pipeline components
-    instruction_memory instr_mem;
-    register_memory reg_file;
-    data_memory data_mem;
-    program_counter pc;
-    imm_gen im_gen;
+    friend class Debugger;
+    friend class Profiler;
 
+protected:
+    // Per-cycle state comes first and starts on a cache line, so the latches
+    // sit together instead of behind the register file and data memory
     // Pipeline registers
-    IF_ID_register_file IF_ID;
+    alignas(64) IF_ID_register_file IF_ID;
     ID_EX_register_file ID_EX;
     EX_MEM_register_file EX_MEM;
     MEM_WB_register_file MEM_WB;
+    // Written by the stages during a cycle, copied over the registers above by clock_edge()
+    pipeline_latches next;
+    // fetch() produced an instruction this cycle; hazards are only checked then
+    bool fetched = false;
 
     // Control signals
     ControlSignals control;
     PC_handler pc_handler;
+    program_counter pc;
 
     // Cycle tracking
-    int cycle_count = 0;
+    uint64_t cycle_count = 0;
+    // Retired instructions, stalls and flushes; cycles is filled in by counters()
+    pipeline_counters events;
+    // counters() as of the clock edge that began this cycle; CSR reads in EX use
+    // it, so they do not see WB's retirement from the same cycle
+    pipeline_counters edge_counters;
+    // Squashed wrong-path instructions by kind (events.wrong_path is the total)
+    struct wrong_path_counters
+    {
+        uint64_t loads = 0;
+        uint64_t stores = 0;
+        uint64_t control = 0;
+        uint64_t other = 0;
+    } wrong_path;
+    // Accesses per structure for the energy estimate; register file ports are counted by reg_file
+    activity_counters activity;
+    // The roi CSR and the statistics of the regions it marked
+    region_of_interest roi;
 
     MUX_WB mux_wb;
 
-    /*          For testing purpose                 */
-    // Instruction tracking for pipeline diagram
-    vector<string> instruction_strings;
+    // Pipeline components
+    instruction_memory instr_mem;
+    register_memory reg_file;
+    data_memory data_mem;
+    imm_gen im_gen;
+
+    // Optional per-instruction cycle attribution
+    Profiler *profiler = nullptr;
+
+    // Optional write-combining buffer between MEM and data memory (off by default)
+    store_buffer store_buf;
+
+    // Optional evaluation of speculative load hoisting over the committed stream (off by default)
+    store_set_predictor store_sets;
 
-    vector<string> pipeline_states;
+    // Memory-mapped console, exit and cycle counter (mmio.hpp)
+    mmio_bus bus;
+    standard_devices devices;
 
-    // Load instructions from file
-    void load_instructions(const string &filename);
+    // Host time per stage; only filled in when built with PROCSIM_HOST_PROFILE
+    host_timers timers;
+
+    // Trace replay: records stand in for instruction memory, instr_index is the record number
+    instruction_trace *trace = nullptr;
+    uint64_t trace_next = 0;
+    // Committed instructions are streamed here when set
+    trace_writer *recorder = nullptr;
+    // Periodic statistics snapshots go here when set
+    stats_writer *stats = nullptr;
+
+    // .data contents of an assembled program, copied into data memory on load
+    map<uint64_t, int64_t> program_data;
+
+    // Sparse pipeline diagram; text output is rebuilt from it, rows labelled on demand
+    sparse_diagram diagram;
+    bool diagram_recording = true;
+    // Threaded runs: diagram and trace output on a worker, fed one event per cycle
+    unique_ptr<cycle_offload> offload;
+    cycle_event event = {};
+
+    // Parse "hex [assembly]" lines into instruction memory
+    void load_instructions(istream &input);
 
     // Pipeline stage functions
     void generate_control_signals(bool stall);
     void generate_alu_ops(ALU::Operation &operation);
 
-    // Run in reverse order
+    // Fill IF_ID at pc (or from the trace); false once there is nothing left to fetch
+    bool fetch_instruction();
+    bool fetch_traced();
+    // beq/bne register comparison for the instruction in IF_ID, recovered from the trace on replay
+    bool branch_equal(bool computed) const;
+    // Count the instruction flushed from IF_ID by the hazard decision just made
+    void squash_wrong_path();
+    // Zicsr access by the instruction in EX; returns the old value for rd
+    int64_t csr_access(uint32_t instruction, int64_t rs1_value);
+    // Value MEM_WB is writing back this cycle
+    int64_t writeback_value() const { return MEM_WB.memToReg ? MEM_WB.read_data : MEM_WB.alu_result; }
+
+public:
+    // Pure decoders shared with the functional engine
+    static ControlSignals decode_control(uint32_t instruction);
+    static ALU::Operation decode_alu_op(uint32_t instruction, uint8_t aluOp);
+
+protected:
+
+    // Each stage reads the current pipeline registers and edge_counters and
+    // writes next; the register file is written in WB but ID takes WB's value
+    // through the bypass, so step() may call them in any order
     virtual void fetch() = 0;
     virtual void decode() = 0;
     virtual void execute() = 0;
     void memory_access();
     void write_back();
+    // Latch next into the pipeline registers
+    void clock_edge();
+    // Ready bits the hazard units test, from the registers just latched
+    void update_scoreboard();
+    // Stall, flush and redirect decisions for the next cycle, from the registers just latched
+    virtual void resolve_hazards() = 0;
 
     // Generate pipeline diagram
     void update_pipeline_diagram();
 
 public:
-    Processor() = default;
+    Processor();
     virtual ~Processor() = default;
+    // Devices hold callbacks into this instance
+    Processor(const Processor &) = delete;
+    Processor &operator=(const Processor &) = delete;
 
     void load_program(const string &filename);
-    virtual void run_simulation(int max_cycles);
+    void load_program(istream &input);
+    // Replay a recorded trace instead of running a program (trace.hpp); the trace
+    // must outlive the run. Registers and memory hold no values during a replay.
+    void load_trace(instruction_trace &recorded);
+    bool replaying() const { return trace != nullptr; }
+    // Stream every committed instruction to writer (nullptr stops)
+    void record_trace(trace_writer *writer);
+    // Queue a statistics snapshot to writer at each of its intervals (nullptr stops)
+    void record_stats(stats_writer *writer) { stats = writer; }
+    virtual void run_simulation(uint64_t max_cycles);
+
+    // Advance the pipeline by exactly one clock cycle
+    void step();
+    // True once every instruction has left the pipeline
+    bool pipeline_drained() const;
+    // True once the program has written the exit register
+    bool halted() const { return devices.halted; }
+    int64_t exit_code() const { return devices.exit_code; }
+    bool finished() const { return halted() || pipeline_drained(); }
+    // Hash of the whole machine state: registers, memory and every pipeline latch.
+    // Pending store-buffer entries are not included; compare only while it is empty.
+    uint64_t state_hash() const;
+    bool store_buffer_empty() const { return store_buf.empty(); }
     void print_pipeline_diagram() const;
+
+    // Loaded instruction words
+    const vector<uint32_t> &program() const { return instr_mem.instructions; }
+    // Initial data memory from an assembly program's .data section
+    const map<uint64_t, int64_t> &data_image() const { return program_data; }
+
+    // Architectural state
+    uint64_t cycles() const { return cycle_count; }
+    // Event counts so far, as read through the cycle and instret CSRs
+    pipeline_counters counters() const;
+    stats_snapshot snapshot() const;
+    uint64_t fetch_pc() const { return pc.instruction_address; }
+    int64_t register_value(int index) const { return reg_file.registers[index & 31]; }
+    int64_t memory_value(uint64_t address) const;
+
+    // Seed registers and data memory after load_program (formats in state_image.hpp)
+    size_t load_memory_image(const memory_image_spec &spec);
+    void load_register_image(const string &path);
+
+    // entries == 0 writes stores straight to memory; interval is cycles per drained entry
+    void configure_store_buffer(size_t entries, uint32_t drain_interval = 1) { store_buf.configure(entries, drain_interval); }
+    const store_buffer::counters &store_buffer_stats() const { return store_buf.stats; }
+    void report_store_buffer(ostream &out) const;
+
+    // Loads may pass the stores among the previous window instructions (0 turns it off)
+    void configure_store_sets(size_t window) { store_sets.configure(window); }
+    const store_set_predictor::counters &store_set_stats() const { return store_sets.stats; }
+    void report_store_sets(ostream &out) const;
+
+    // True once the program has written the roi CSR; the report covers only the marked cycles
+    bool roi_marked() const { return roi.regions != 0; }
+    void report_roi(ostream &out) const { roi.report(out, counters()); }
+    // Instructions fetched behind taken branches and jumps, then squashed
+    void report_wrong_path(ostream &out) const;
+    // Accesses per structure since load_program, always collected
+    activity_counters activity_counts() const;
+    void report_energy(ostream &out, const energy_table &table) const
+    {
+        ::report_energy(out, activity_counts(), table, events.instructions);
+    }
+
+    // Memory-mapped devices; console output is dropped until a stream is set
+    mmio_bus &mmio() { return bus; }
+    void set_console(ostream *out) { devices.console = out; }
+    void flush_console() { devices.flush_console(); }
+
+    // Keep no diagram at all, only the cycle count; for long runs where it would not fit
+    void set_diagram_recording(bool enabled) { diagram_recording = enabled; }
+    // Keep the diagram and trace recorder on a second host thread; results are unchanged
+    void set_threaded(bool enabled);
+    // Wait for the worker of a threaded run to catch up with the simulation
+    void sync() const;
+    void write_diagram(ostream &out, diagram_format format) const;
+
+    // Host ns per simulated cycle for each stage (HOST_PROFILE=1 builds only)
+    void report_host_profile(ostream &out) const;
+
+    // Sample the profiler every cycle from now on (nullptr detaches)
+    void attach_profiler(Profiler *p);
 };
 
 #endif // PROCESSOR_HPP
\ No newline at end of file
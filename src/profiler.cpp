@@ -0,0 +1,137 @@
+#include "profiler.hpp"
+#include "processor.hpp"
+#include "disassembler.hpp"
+#include <algorithm>
+#include <iomanip>
+#include <numeric>
+
+void Profiler::reset(const vector<uint32_t> &program)
+{
+    size_t n = program.size();
+    cycles.assign(n, 0);
+    stalls.assign(n, 0);
+    flushes.assign(n, 0);
+    executions.assign(n, 0);
+    leaders.assign(n, false);
+    if (n)
+        leaders[0] = true;
+
+    instructions = program;
+    redirect_pending = false;
+    total_cycles = 0;
+}
+
+void Profiler::sample(const Processor &cpu)
+{
+    total_cycles++;
+
+    uint64_t fetched = cpu.IF_ID.instr_index;
+
+    // The first fetch after a taken branch/jump starts a basic block
+    if (redirect_pending && fetched != SIZE_MAX)
+        leaders[fetched] = true;
+    redirect_pending = cpu.pc_handler.branch_taken && !cpu.pc_handler.stall;
+
+    // Charge the cycle to the youngest instruction in flight
+    const uint64_t in_flight[5] = {fetched, cpu.ID_EX.instr_index, cpu.EX_MEM.instr_index,
+                                   cpu.MEM_WB.instr_index, cpu.data_mem.wb_index};
+    for (uint64_t index : in_flight)
+    {
+        if (index != SIZE_MAX)
+        {
+            cycles[index]++;
+            break;
+        }
+    }
+
+    if (fetched != SIZE_MAX && cpu.pc_handler.stall)
+        stalls[fetched]++;
+
+    if (cpu.IF_ID.flush && cpu.ID_EX.instr_index != SIZE_MAX)
+        flushes[cpu.ID_EX.instr_index]++;
+
+    if (cpu.data_mem.wb_index != SIZE_MAX)
+        executions[cpu.data_mem.wb_index]++;
+}
+
+vector<size_t> Profiler::block_starts() const
+{
+    vector<size_t> start(instructions.size());
+    size_t current = 0;
+    for (size_t i = 0; i < instructions.size(); i++)
+    {
+        uint32_t prev_opcode = i ? (instructions[i - 1] & 0x7F) : 0;
+        bool after_control = (prev_opcode == 0x63 || prev_opcode == 0x6F || prev_opcode == 0x67);
+        if (leaders[i] || after_control)
+            current = i;
+        start[i] = current;
+    }
+    return start;
+}
+
+string Profiler::frame_name(size_t index) const
+{
+    // Disassembly never contains ';', the folded format's frame separator
+    return index < instructions.size() ? instruction_label(instructions[index]) : "";
+}
+
+void Profiler::report(ostream &out) const
+{
+    vector<size_t> order(cycles.size());
+    iota(order.begin(), order.end(), 0);
+    stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+                { return cycles[a] > cycles[b]; });
+
+    out << "Hot instructions (" << total_cycles << " cycles)\n";
+    out << "    pc      cycles       %    stalls   flushes     execs  instruction\n";
+    for (size_t i : order)
+    {
+        if (cycles[i] == 0 && executions[i] == 0)
+            continue;
+        double share = total_cycles ? 100.0 * cycles[i] / total_cycles : 0.0;
+        out << setw(6) << i * 4 << setw(12) << cycles[i] << setw(8) << fixed << setprecision(2) << share
+            << setw(10) << stalls[i] << setw(10) << flushes[i] << setw(10) << executions[i]
+            << "  " << frame_name(i) << "\n";
+    }
+
+    // Sum instructions into their basic blocks
+    vector<size_t> start = block_starts();
+    vector<size_t> blocks;
+    vector<uint64_t> block_cycles(cycles.size(), 0), block_stalls(cycles.size(), 0), block_flushes(cycles.size(), 0);
+    for (size_t i = 0; i < start.size(); i++)
+    {
+        if (start[i] == i)
+            blocks.push_back(i);
+        block_cycles[start[i]] += cycles[i];
+        block_stalls[start[i]] += stalls[i];
+        block_flushes[start[i]] += flushes[i];
+    }
+    stable_sort(blocks.begin(), blocks.end(), [&](size_t a, size_t b)
+                { return block_cycles[a] > block_cycles[b]; });
+
+    out << "\nHot basic blocks\n";
+    out << "  start     end      cycles       %    stalls   flushes     execs\n";
+    for (size_t b : blocks)
+    {
+        size_t end = b;
+        while (end + 1 < start.size() && start[end + 1] == b)
+            end++;
+        if (block_cycles[b] == 0 && executions[b] == 0)
+            continue;
+        double share = total_cycles ? 100.0 * block_cycles[b] / total_cycles : 0.0;
+        out << setw(7) << b * 4 << setw(8) << end * 4 << setw(12) << block_cycles[b] << setw(8) << fixed
+            << setprecision(2) << share << setw(10) << block_stalls[b] << setw(10) << block_flushes[b]
+            << setw(10) << executions[b] << "\n";
+    }
+}
+
+void Profiler::folded(ostream &out) const
+{
+    vector<size_t> start = block_starts();
+    for (size_t i = 0; i < cycles.size(); i++)
+    {
+        if (cycles[i] == 0)
+            continue;
+        out << "bb_" << start[i] * 4 << ";" << i * 4 << " " << frame_name(i) << " " << cycles[i] << "\n";
+    }
+}
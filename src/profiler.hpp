@@ -0,0 +1,50 @@
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+class Processor;
+
+// Attributes simulated cycles, stalls and flushes to static instructions and
+// basic blocks. All counters are flat arrays indexed by instr_index, so a
+// sample is a handful of increments per cycle.
+class Profiler
+{
+private:
+    vector<uint64_t> cycles;     // cycle charged to the youngest in-flight instruction
+    vector<uint64_t> stalls;     // cycles held in IF by a hazard
+    vector<uint64_t> flushes;    // wrong-path fetches squashed by this control instruction
+    vector<uint64_t> executions; // times written back
+    vector<bool> leaders;        // basic block starts seen as branch/jump targets
+
+    vector<uint32_t> instructions; // rows are labelled by disassembling these
+    bool redirect_pending = false;
+    uint64_t total_cycles = 0;
+
+    // Block start of every instruction, from observed targets plus static fall-throughs
+    vector<size_t> block_starts() const;
+    string frame_name(size_t index) const;
+
+public:
+    Profiler() = default;
+
+    void reset(const vector<uint32_t> &program);
+    void sample(const Processor &cpu);
+
+    uint64_t sampled_cycles() const { return total_cycles; }
+    uint64_t cycles_at(size_t index) const { return cycles[index]; }
+    uint64_t stalls_at(size_t index) const { return stalls[index]; }
+    uint64_t flushes_at(size_t index) const { return flushes[index]; }
+
+    // Per-instruction table sorted by cycles, then per-block totals
+    void report(ostream &out) const;
+    // Folded stacks ("block;instruction cycles") for flamegraph.pl / speedscope
+    void folded(ostream &out) const;
+};
+
+#endif // PROFILER_HPP
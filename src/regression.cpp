@@ -0,0 +1,406 @@
+// Golden regression: every program in the input directory runs through both
+// pipelines in-process, one Simulator per worker thread, and its diagram is
+// compared with <name>_<mode>_out.txt in the golden directory. The same run
+// also writes the CSV, JSON and binary sparse diagrams, which are read back
+// and printed as text (what diagram_viewer does) for the same comparison; a
+// synthetic diagram past 2^32 cycles checks the sparse formats keep full-width
+// cycle numbers, and a small load-use program checks the profiler's cycle,
+// stall and flush attribution and its folded output. The cycle loop is then
+// timed on its own, serially, and compared with a baseline taken on the same
+// host. Host timings are noisy, so the comparison only reports by default;
+// with --perf-gate a slowdown past the threshold fails the run like a wrong
+// diagram does.
+//
+//   ./procsim_regression [options]   (make test, make test-perf, make test-baseline)
+
+#include "bench_program.hpp"
+#include "diagram.hpp"
+#include "simulator.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+struct regression_case
+{
+    std::string name;
+    std::string input;
+    PipelineMode mode;
+    std::string golden;
+    std::string failure; // empty once the diagram matched
+};
+
+static void usage(const char *program)
+{
+    std::cerr << "Usage: " << program << " [options]\n"
+              << "  --inputs=DIR          programs to run (default ../inputfiles)\n"
+              << "  --golden=DIR          expected diagrams (default ../outputfiles)\n"
+              << "  --baseline=FILE       ns per cycle on this host to compare against (default perf_baseline.txt)\n"
+              << "  --threshold=PCT       slowdown over the baseline reported as a regression (default 20)\n"
+              << "  --perf-gate           fail the run on a regression instead of only reporting it\n"
+              << "  --cycles=N            cycles per timed run (default 1000000)\n"
+              << "  --repeats=N           timed runs per pipeline, the median is used (default 5)\n"
+              << "  --update-baseline     store this host's timings as the new baseline\n"
+              << "  --jobs=N              worker threads (default: hardware threads)\n";
+}
+
+static std::string read_file(const std::string &path)
+{
+    std::ifstream in(path, std::ios::binary);
+    if (!in.is_open())
+        throw std::runtime_error("Could not open file " + path);
+    std::ostringstream text;
+    text << in.rdbuf();
+    return text.str();
+}
+
+// Line number (from 1) of the first difference, and both versions of it
+static std::string first_difference(const std::string &expected, const std::string &actual)
+{
+    std::istringstream want(expected), got(actual);
+    std::string a, b;
+    for (size_t line = 1;; line++)
+    {
+        bool more_a = (bool)std::getline(want, a);
+        bool more_b = (bool)std::getline(got, b);
+        if (!more_a && !more_b)
+            return "differs in line endings";
+        if (!more_a || !more_b || a != b)
+            return "line " + std::to_string(line) + ":\n    expected: " + (more_a ? a : "<end of file>") +
+                   "\n    actual:   " + (more_b ? b : "<end of file>");
+    }
+}
+
+static const diagram_format sparse_formats[] = {diagram_format::csv, diagram_format::json, diagram_format::binary};
+static const char *const sparse_format_names[] = {"csv", "json", "bin"};
+
+// Text diagram rebuilt from a sparse encoding, as diagram_viewer prints it
+static std::string sparse_to_text(const std::string &encoded)
+{
+    std::istringstream in(encoded, std::ios::binary);
+    std::ostringstream text;
+    sparse_diagram::read(in).write(text, diagram_format::text);
+    return text.str();
+}
+
+static void run_case(regression_case &c)
+{
+    try
+    {
+        std::string expected = read_file(c.golden);
+        Simulator sim(c.mode);
+        sim.load_file(c.input);
+        std::ostringstream diagram;
+        sim.add_diagram_sink(diagram);
+        std::ostringstream sparse[3];
+        for (int f = 0; f < 3; f++)
+            sim.add_diagram_sink(sparse[f], sparse_formats[f]);
+        sim.run_until(run_limits());
+        sim.write_outputs();
+        if (diagram.str() != expected)
+        {
+            c.failure = first_difference(expected, diagram.str());
+            return;
+        }
+        for (int f = 0; f < 3; f++)
+        {
+            std::string text = sparse_to_text(sparse[f].str());
+            if (text != expected)
+            {
+                c.failure = std::string(sparse_format_names[f]) + " read back, " + first_difference(expected, text);
+                return;
+            }
+        }
+    }
+    catch (const std::exception &e)
+    {
+        c.failure = e.what();
+    }
+}
+
+// Two rows whose cycles start past 2^32, written in each sparse format and read
+// back; the text form would be billions of columns wide, so cells and the
+// frontier are compared instead. Empty when every format keeps them.
+static std::string check_wide_cycles()
+{
+    sparse_diagram d;
+    d.reset(std::vector<uint32_t>{0x00000013, 0x00a282b3});
+    const uint64_t base = (1ull << 32) + 123456789;
+    for (int s = 0; s < 5; s++)
+    {
+        d.record(base + s, 0, 1 << s);
+        d.record(base + s + 1, 1, 1 << s);
+        d.record_frontier(base + s, s < 1 ? 0 : 1);
+    }
+    for (int f = 0; f < 3; f++)
+    {
+        std::stringstream encoded(std::ios::in | std::ios::out | std::ios::binary);
+        d.write(encoded, sparse_formats[f]);
+        sparse_diagram back = sparse_diagram::read(encoded);
+        bool same = back.rows() == d.rows() && back.cycles == d.cycles && back.frontier == d.frontier;
+        for (size_t r = 0; same && r < d.rows(); r++)
+        {
+            same = back.cells[r].size() == d.cells[r].size();
+            for (size_t i = 0; same && i < d.cells[r].size(); i++)
+                same = back.cells[r][i].cycle == d.cells[r][i].cycle && back.cells[r][i].stages == d.cells[r][i].stages;
+        }
+        if (!same)
+            return std::string(sparse_format_names[f]) + " loses cycles past 2^32";
+    }
+    return "";
+}
+
+// A load-use pair followed by a taken branch over one instruction: the addi
+// waits in IF/ID for the load (one cycle with forwarding, two without) and the
+// beq squashes the addi fetched behind it
+static const char *const profile_program = "00032e03 lw x28 0 x6\n"
+                                           "001e0e13 addi x28 x28 1\n"
+                                           "00000463 beq x0 x0 8\n"
+                                           "001e8e93 addi x29 x29 1\n"
+                                           "001f0f13 addi x30 x30 1\n";
+
+// Profiler attribution on profile_program: every cycle is charged to exactly
+// one pc, stalls go to the load's consumer, the flush to the branch, and the
+// folded stacks carry the same per-pc cycles under the right blocks. Empty
+// when everything adds up.
+static std::string check_profiler(PipelineMode mode)
+{
+    Simulator sim(mode);
+    sim.load_buffer(profile_program);
+    sim.enable_profiler();
+    sim.run_until(run_limits());
+    const Profiler &p = sim.profile();
+
+    uint64_t cycles = 0, stalls = 0, flushes = 0;
+    for (size_t i = 0; i < sim.program().size(); i++)
+    {
+        cycles += p.cycles_at(i);
+        stalls += p.stalls_at(i);
+        flushes += p.flushes_at(i);
+    }
+    if (p.sampled_cycles() != sim.cycles() || cycles != sim.cycles())
+        return "per-pc cycles add up to " + std::to_string(cycles) + ", the run took " + std::to_string(sim.cycles());
+    uint64_t expected_stalls = mode == PipelineMode::Forward ? 1 : 2;
+    if (p.stalls_at(1) != expected_stalls || stalls != expected_stalls)
+        return "load-use consumer has " + std::to_string(p.stalls_at(1)) + " of " + std::to_string(stalls) +
+               " stall cycles, expected " + std::to_string(expected_stalls);
+    if (p.flushes_at(2) != 1 || flushes != 1)
+        return "branch has " + std::to_string(p.flushes_at(2)) + " of " + std::to_string(flushes) + " flushes, expected 1";
+
+    // "bb_<block pc>;<pc> <disassembly> <cycles>", the branch target opening its own block
+    std::ostringstream folded;
+    p.folded(folded);
+    std::istringstream lines(folded.str());
+    std::string line;
+    uint64_t folded_cycles = 0;
+    while (std::getline(lines, line))
+    {
+        size_t split = line.find(';');
+        size_t count = line.rfind(' ');
+        if (split == std::string::npos || count == std::string::npos)
+            return "malformed folded line: " + line;
+        uint64_t block = std::stoull(line.substr(3, split - 3));
+        uint64_t pc = std::stoull(line.substr(split + 1));
+        uint64_t n = std::stoull(line.substr(count + 1));
+        uint64_t expected_block = pc <= 8 ? 0 : pc;
+        if (block != expected_block || n != p.cycles_at(pc / 4))
+            return "folded line \"" + line + "\" does not match the profile";
+        folded_cycles += n;
+    }
+    if (folded_cycles != sim.cycles())
+        return "folded stacks add up to " + std::to_string(folded_cycles) + " cycles, the run took " +
+               std::to_string(sim.cycles());
+    return "";
+}
+
+// Host nanoseconds per simulated cycle on the bench loop, median of repeats runs
+static double ns_per_cycle(PipelineMode mode, uint64_t cycles, unsigned repeats)
+{
+    std::vector<double> runs;
+    for (unsigned attempt = 0; attempt < repeats; attempt++)
+    {
+        Simulator sim(mode);
+        sim.load_buffer(bench_program);
+        auto start = std::chrono::steady_clock::now();
+        uint64_t ran = sim.run(cycles);
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        runs.push_back(seconds * 1e9 / (ran ? ran : 1));
+    }
+    std::sort(runs.begin(), runs.end());
+    size_t middle = runs.size() / 2;
+    return runs.size() % 2 ? runs[middle] : (runs[middle - 1] + runs[middle]) / 2;
+}
+
+static std::map<std::string, double> read_baseline(const std::string &path)
+{
+    std::map<std::string, double> baseline;
+    std::ifstream in(path);
+    std::string line;
+    while (std::getline(in, line))
+    {
+        if (line.empty() || line[0] == '#')
+            continue;
+        std::istringstream fields(line);
+        std::string name;
+        double ns;
+        if (fields >> name >> ns)
+            baseline[name] = ns;
+    }
+    return baseline;
+}
+
+static void write_baseline(const std::string &path, const std::map<std::string, double> &timings, uint64_t cycles,
+                           unsigned repeats)
+{
+    std::ofstream out(path);
+    if (!out.is_open())
+        throw std::runtime_error("Could not open file " + path);
+    out << "# host ns per simulated cycle on the bench loop, median of " << repeats << " runs of " << cycles
+        << " cycles\n"
+        << "# machine-specific, not for version control: regenerate with make test-baseline\n";
+    for (const auto &t : timings)
+        out << t.first << ' ' << t.second << '\n';
+}
+
+int main(int argc, char *argv[])
+{
+    try
+    {
+        std::string inputDir = "../inputfiles";
+        std::string goldenDir = "../outputfiles";
+        std::string baselinePath = "perf_baseline.txt";
+        double threshold = 20;
+        bool perfGate = false;
+        uint64_t cycles = 1000000;
+        unsigned repeats = 5;
+        bool updateBaseline = false;
+        unsigned jobs = std::max(1u, std::thread::hardware_concurrency());
+
+        for (int i = 1; i < argc; i++)
+        {
+            std::string option = argv[i];
+            if (option.rfind("--inputs=", 0) == 0) {
+                inputDir = option.substr(9);
+            } else if (option.rfind("--golden=", 0) == 0) {
+                goldenDir = option.substr(9);
+            } else if (option.rfind("--baseline=", 0) == 0) {
+                baselinePath = option.substr(11);
+            } else if (option.rfind("--threshold=", 0) == 0) {
+                threshold = std::stod(option.substr(12));
+            } else if (option == "--perf-gate") {
+                perfGate = true;
+            } else if (option.rfind("--cycles=", 0) == 0) {
+                cycles = std::stoull(option.substr(9));
+            } else if (option.rfind("--repeats=", 0) == 0) {
+                repeats = std::max(1, std::stoi(option.substr(10)));
+            } else if (option == "--update-baseline") {
+                updateBaseline = true;
+            } else if (option.rfind("--jobs=", 0) == 0) {
+                jobs = std::max(1, std::stoi(option.substr(7)));
+            } else {
+                usage(argv[0]);
+                return 2;
+            }
+        }
+
+        std::vector<regression_case> cases;
+        std::vector<fs::path> inputs;
+        for (const auto &entry : fs::directory_iterator(inputDir))
+            if (entry.is_regular_file() && entry.path().extension() == ".txt")
+                inputs.push_back(entry.path());
+        std::sort(inputs.begin(), inputs.end());
+        for (const fs::path &input : inputs)
+            for (PipelineMode mode : {PipelineMode::Forward, PipelineMode::NoForward})
+            {
+                std::string name = input.stem().string() + "_" + pipeline_mode_name(mode);
+                cases.push_back({name, input.string(), mode, goldenDir + "/" + name + "_out.txt", ""});
+            }
+
+        std::atomic<size_t> next{0};
+        std::vector<std::thread> workers;
+        for (unsigned j = 0; j < std::min<size_t>(jobs, cases.size()); j++)
+            workers.emplace_back([&]() {
+                for (size_t i; (i = next.fetch_add(1)) < cases.size();)
+                    run_case(cases[i]);
+            });
+        for (std::thread &worker : workers)
+            worker.join();
+
+        int failures = 0;
+        for (const regression_case &c : cases)
+        {
+            if (c.failure.empty())
+                continue;
+            std::cout << "FAIL " << c.name << ": " << c.failure << "\n";
+            failures++;
+        }
+        std::cout << cases.size() - failures << "/" << cases.size()
+                  << " diagrams match the golden files, also read back from csv, json and bin\n";
+        std::string wide = check_wide_cycles();
+        if (!wide.empty())
+        {
+            std::cout << "FAIL sparse diagram: " << wide << "\n";
+            failures++;
+        }
+        bool profiles_match = true;
+        for (PipelineMode mode : {PipelineMode::Forward, PipelineMode::NoForward})
+        {
+            std::string profile = check_profiler(mode);
+            if (!profile.empty())
+            {
+                std::cout << "FAIL profiler " << pipeline_mode_name(mode) << ": " << profile << "\n";
+                profiles_match = false;
+                failures++;
+            }
+        }
+        if (profiles_match)
+            std::cout << "profiler: cycle, stall and flush attribution and folded stacks checked in both pipelines\n";
+
+        // Timed after the parallel phase so the runs do not compete for cores
+        std::map<std::string, double> timings;
+        for (PipelineMode mode : {PipelineMode::Forward, PipelineMode::NoForward})
+            timings[pipeline_mode_name(mode)] = ns_per_cycle(mode, cycles, repeats);
+
+        std::map<std::string, double> baseline = read_baseline(baselinePath);
+        std::cout << std::fixed << std::setprecision(1);
+        if (updateBaseline || baseline.empty())
+        {
+            write_baseline(baselinePath, timings, cycles, repeats);
+            std::cout << "Wrote baseline " << baselinePath << "\n";
+        }
+        else
+        {
+            for (const auto &t : timings)
+            {
+                auto found = baseline.find(t.first);
+                if (found == baseline.end())
+                {
+                    std::cout << "perf " << t.first << ": " << t.second << " ns/cycle, no baseline\n";
+                    continue;
+                }
+                double change = 100.0 * (t.second / found->second - 1);
+                bool regressed = change > threshold;
+                const char *verdict = !regressed ? "" : perfGate ? "FAIL " : "SLOWER ";
+                std::cout << verdict << "perf " << t.first << ": " << t.second << " ns/cycle, baseline "
+                          << found->second << " (" << (change >= 0 ? "+" : "") << change << "%, threshold " << threshold << "%)\n";
+                if (regressed && perfGate)
+                    failures++;
+            }
+        }
+        return failures ? 1 : 0;
+    }
+    catch (const std::exception &e)
+    {
+        std::cerr << "Error during regression: " << e.what() << std::endl;
+        return 2;
+    }
+}
@@ -0,0 +1,197 @@
+#include "simulator.hpp"
+#include "forward_processor.hpp"
+#include "no_forward_processor.hpp"
+#include <chrono>
+#include <sstream>
+#include <stdexcept>
+
+PipelineMode parse_pipeline_mode(const string &name)
+{
+    if (name == "forward")
+        return PipelineMode::Forward;
+    if (name == "noforward")
+        return PipelineMode::NoForward;
+    throw runtime_error("unknown pipeline mode: " + name);
+}
+
+const char *pipeline_mode_name(PipelineMode mode)
+{
+    return mode == PipelineMode::Forward ? "forward" : "noforward";
+}
+
+Simulator::Simulator(PipelineMode pipeline_mode) : mode(pipeline_mode)
+{
+    fresh_processor();
+}
+
+void Simulator::fresh_processor()
+{
+    if (mode == PipelineMode::Forward)
+        cpu = make_unique<ForwardingProcessor>();
+    else
+        cpu = make_unique<NoForwardingProcessor>();
+
+    cpu->set_console(console);
+    cpu->record_trace(recorder);
+    cpu->record_stats(stats);
+    cpu->configure_store_buffer(store_buffer_entries, store_buffer_drain);
+    cpu->configure_store_sets(store_set_window);
+
+    cpu->set_diagram_recording(diagram_recording);
+    cpu->set_threaded(threaded);
+}
+
+void Simulator::load_file(const string &path)
+{
+    fresh_processor();
+    cpu->load_program(path);
+    if (profiling)
+        cpu->attach_profiler(&profiler);
+}
+
+void Simulator::load_buffer(const string &program_text)
+{
+    fresh_processor();
+    istringstream input(program_text);
+    cpu->load_program(input);
+    if (profiling)
+        cpu->attach_profiler(&profiler);
+}
+
+void Simulator::load_buffer(const char *data, size_t size)
+{
+    load_buffer(string(data, size));
+}
+
+void Simulator::load_trace(const string &path)
+{
+    // The processor keeps a pointer to the old trace until it is replaced
+    fresh_processor();
+    trace = make_unique<instruction_trace>(path);
+    cpu->load_trace(*trace);
+}
+
+uint64_t Simulator::run(uint64_t max_cycles)
+{
+    uint64_t ran = 0;
+    while (ran < max_cycles && step())
+        ran++;
+    cpu->sync();
+    cpu->flush_console();
+    return ran;
+}
+
+StopReason Simulator::run_until(const run_limits &limits)
+{
+    using clock = chrono::steady_clock;
+    const clock::time_point deadline = clock::now() + chrono::duration_cast<clock::duration>(
+                                                          chrono::duration<double>(limits.max_seconds));
+    loop_detector loops;
+    StopReason reason = StopReason::None;
+
+    for (uint64_t ran = 0; reason == StopReason::None; ran++)
+    {
+        if (cpu->halted())
+            reason = StopReason::Halted;
+        else if (cpu->pipeline_drained())
+            reason = StopReason::Drained;
+        else if (limits.max_cycles && ran >= limits.max_cycles)
+            reason = StopReason::MaxCycles;
+        // Reading the clock costs more than a cycle, so only look now and then
+        else if (limits.max_seconds > 0 && (ran & 0xFFF) == 0 && clock::now() >= deadline)
+            reason = StopReason::TimeLimit;
+        else
+        {
+            cpu->step();
+            // Every 8th cycle is enough: a periodic machine is periodic on any stride
+            if (limits.detect_loops && (cpu->cycles() & 7) == 0 && cpu->store_buffer_empty() &&
+                loops.observe(cpu->state_hash(), cpu->cycles()))
+                reason = StopReason::Looping;
+        }
+    }
+
+    loop_cycles = loops.period;
+    cpu->sync();
+    cpu->flush_console();
+    return reason;
+}
+
+bool Simulator::step()
+{
+    if (cpu->finished())
+        return false;
+    cpu->step();
+    return true;
+}
+
+void Simulator::set_console(ostream &out)
+{
+    console = &out;
+    cpu->set_console(console);
+}
+
+void Simulator::record_trace(trace_writer *writer)
+{
+    recorder = writer;
+    cpu->record_trace(recorder);
+}
+
+void Simulator::record_stats(stats_writer *writer)
+{
+    stats = writer;
+    cpu->record_stats(stats);
+}
+
+void Simulator::configure_store_buffer(size_t entries, uint32_t drain_interval)
+{
+    store_buffer_entries = entries;
+    store_buffer_drain = drain_interval;
+    cpu->configure_store_buffer(entries, drain_interval);
+}
+
+void Simulator::configure_store_sets(size_t window)
+{
+    store_set_window = window;
+    cpu->configure_store_sets(window);
+}
+
+void Simulator::add_diagram_sink(ostream &out, diagram_format format)
+{
+    diagram_sinks.push_back({&out, format});
+}
+
+void Simulator::record_diagram(bool enabled)
+{
+    diagram_recording = enabled;
+    cpu->set_diagram_recording(enabled);
+}
+
+void Simulator::set_threaded(bool enabled)
+{
+    threaded = enabled;
+    cpu->set_threaded(enabled);
+}
+
+void Simulator::add_profile_sink(ostream &out)
+{
+    profile_sinks.push_back(&out);
+    enable_profiler();
+}
+
+void Simulator::enable_profiler()
+{
+    if (!profiling)
+    {
+        profiling = true;
+        cpu->attach_profiler(&profiler);
+    }
+}
+
+void Simulator::write_outputs() const
+{
+    cpu->flush_console();
+    for (const auto &s : diagram_sinks)
+        cpu->write_diagram(*s.out, s.format);
+    for (ostream *out : profile_sinks)
+        profiler.report(*out);
+}
@@ -0,0 +1,121 @@
+#ifndef SIMULATOR_HPP
+#define SIMULATOR_HPP
+
+#include "processor.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+// Embeddable front door to libprocsim. A Simulator owns one processor and no
+// global state, so independent instances can run on separate threads.
+
+enum class PipelineMode
+{
+    Forward,
+    NoForward
+};
+
+// Bounds for run_until(); zero means no limit
+struct run_limits
+{
+    uint64_t max_cycles = 0;
+    double max_seconds = 0;
+    // Stop as soon as the machine repeats a state, i.e. can never finish
+    bool detect_loops = true;
+};
+
+PipelineMode parse_pipeline_mode(const string &name);
+const char *pipeline_mode_name(PipelineMode mode);
+
+class Simulator
+{
+private:
+    PipelineMode mode;
+    unique_ptr<Processor> cpu;
+    Profiler profiler;
+    bool profiling = false;
+    ostream *console = nullptr;
+    unique_ptr<instruction_trace> trace;
+    trace_writer *recorder = nullptr;
+    stats_writer *stats = nullptr;
+    size_t store_buffer_entries = 0;
+    uint32_t store_buffer_drain = 1;
+    size_t store_set_window = 0;
+    uint64_t loop_cycles = 0;
+    bool diagram_recording = true;
+    bool threaded = false;
+
+    struct sink
+    {
+        ostream *out;
+        diagram_format format;
+    };
+    vector<sink> diagram_sinks;
+    vector<ostream *> profile_sinks;
+
+    void fresh_processor();
+
+public:
+    explicit Simulator(PipelineMode pipeline_mode = PipelineMode::Forward);
+
+    // Program text: "hex [assembly]" per line, or assembly source (assembler.hpp)
+    void load_file(const string &path);
+    void load_buffer(const string &program_text);
+    void load_buffer(const char *data, size_t size);
+    // Binary trace (trace.hpp) replayed through the pipeline timing instead of a program
+    void load_trace(const string &path);
+
+    // Initial state for the loaded program; see state_image.hpp for the formats
+    size_t load_memory_image(const string &spec) { return cpu->load_memory_image(parse_memory_image_spec(spec)); }
+    void load_register_image(const string &path) { cpu->load_register_image(path); }
+
+    // Run up to max_cycles more cycles; returns the number actually simulated
+    uint64_t run(uint64_t max_cycles);
+    bool step();
+    // Run until the program drains or exits, or a limit stops it; returns which
+    StopReason run_until(const run_limits &limits);
+    // Cycles between two identical states once run_until() returned Looping (a
+    // multiple of the loop's period)
+    uint64_t loop_period() const { return loop_cycles; }
+    bool finished() const { return cpu->finished(); }
+    bool halted() const { return cpu->halted(); }
+    int64_t exit_code() const { return cpu->exit_code(); }
+
+    // Where the program's console device writes; kept across loads
+    void set_console(ostream &out);
+
+    // Committed instructions are appended to writer; kept across loads, writer must outlive the runs
+    void record_trace(trace_writer *writer);
+    // Statistics snapshots are queued to writer; kept across loads, writer must outlive the runs
+    void record_stats(stats_writer *writer);
+
+    // Store buffer between MEM and memory (0 entries = off); kept across loads
+    void configure_store_buffer(size_t entries, uint32_t drain_interval = 1);
+    // Store-set evaluation of load hoisting over window instructions (0 = off); kept across loads
+    void configure_store_sets(size_t window);
+
+    // State queries
+    PipelineMode pipeline_mode() const { return mode; }
+    uint64_t cycles() const { return cpu->cycles(); }
+    uint64_t pc() const { return cpu->fetch_pc(); }
+    int64_t reg(int index) const { return cpu->register_value(index); }
+    int64_t memory(uint64_t address) const { return cpu->memory_value(address); }
+    const vector<uint32_t> &program() const { return cpu->program(); }
+    const map<uint64_t, int64_t> &data_image() const { return cpu->data_image(); }
+
+    // Output sinks, written by write_outputs(). The streams must outlive the call.
+    void add_diagram_sink(ostream &out, diagram_format format = diagram_format::text);
+    // Off: diagrams carry only the cycle count and memory stays flat however long the run; kept across loads
+    void record_diagram(bool enabled);
+    // Diagram and trace output on a second thread (Processor::set_threaded); kept across loads
+    void set_threaded(bool enabled);
+    void add_profile_sink(ostream &out);
+    void enable_profiler();
+    void write_outputs() const;
+
+    // Direct access for tools that drive the pipeline themselves (e.g. Debugger)
+    Processor &processor() { return *cpu; }
+    const Profiler &profile() const { return profiler; }
+};
+
+#endif // SIMULATOR_HPP
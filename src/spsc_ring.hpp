@@ -0,0 +1,69 @@
+#ifndef SPSC_RING_HPP
+#define SPSC_RING_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+using namespace std;
+
+// Fixed-capacity single-producer single-consumer queue. Each side owns one
+// index and only reads the other's, so neither push nor pop takes a lock: the
+// release store of an index publishes the slots behind it. Each side also
+// keeps a stale copy of the other's index and rereads it only when the ring
+// looks full (or empty), so the indices do not bounce between cores per item.
+template <typename T>
+class spsc_ring
+{
+    vector<T> slots;
+    size_t mask;
+
+    alignas(64) atomic<size_t> head{0}; // next slot to fill; written by the producer
+    size_t tail_seen = 0;               // producer's copy of tail
+    alignas(64) atomic<size_t> tail{0}; // next slot to drain; written by the consumer
+    size_t head_seen = 0;               // consumer's copy of head
+
+public:
+    // capacity is rounded up to a power of two
+    explicit spsc_ring(size_t capacity)
+    {
+        size_t size = 1;
+        while (size < capacity)
+            size *= 2;
+        slots.resize(size);
+        mask = size - 1;
+    }
+
+    bool try_push(const T &item)
+    {
+        size_t h = head.load(memory_order_relaxed);
+        if (h - tail_seen == slots.size())
+        {
+            tail_seen = tail.load(memory_order_acquire);
+            if (h - tail_seen == slots.size())
+                return false;
+        }
+        slots[h & mask] = item;
+        head.store(h + 1, memory_order_release);
+        return true;
+    }
+
+    bool try_pop(T &item)
+    {
+        size_t t = tail.load(memory_order_relaxed);
+        if (t == head_seen)
+        {
+            head_seen = head.load(memory_order_acquire);
+            if (t == head_seen)
+                return false;
+        }
+        item = slots[t & mask];
+        tail.store(t + 1, memory_order_release);
+        return true;
+    }
+
+    // Consumer side: nothing left to pop
+    bool empty() const { return tail.load(memory_order_relaxed) == head.load(memory_order_acquire); }
+};
+
+#endif // SPSC_RING_HPP
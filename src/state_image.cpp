@@ -0,0 +1,188 @@
+#include "state_image.hpp"
+#include <cstring>
+#include <fcntl.h>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static bool is_binary_image(const string &path)
+{
+    return path.size() >= 4 && path.compare(path.size() - 4, 4, ".bin") == 0;
+}
+
+static int64_t sign_extend(uint64_t value, unsigned width)
+{
+    if (width >= 8)
+        return (int64_t)value;
+    unsigned shift = 64 - width * 8;
+    return (int64_t)(value << shift) >> shift;
+}
+
+// Read-only view of a whole file, unmapped on scope exit
+class mapped_file
+{
+    const uint8_t *bytes = nullptr;
+    size_t length = 0;
+
+public:
+    explicit mapped_file(const string &path)
+    {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw runtime_error("Could not open file " + path);
+        struct stat info;
+        if (fstat(fd, &info) != 0)
+        {
+            close(fd);
+            throw runtime_error("Could not stat " + path);
+        }
+        length = info.st_size;
+        if (length > 0)
+        {
+            void *view = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (view == MAP_FAILED)
+            {
+                close(fd);
+                throw runtime_error("Could not map " + path);
+            }
+            bytes = static_cast<const uint8_t *>(view);
+        }
+        close(fd);
+    }
+    ~mapped_file()
+    {
+        if (bytes)
+            munmap(const_cast<uint8_t *>(bytes), length);
+    }
+    mapped_file(const mapped_file &) = delete;
+    mapped_file &operator=(const mapped_file &) = delete;
+
+    const uint8_t *data() const { return bytes; }
+    size_t size() const { return length; }
+};
+
+static uint64_t read_le(const uint8_t *p, unsigned width)
+{
+    uint64_t value = 0;
+    for (unsigned i = 0; i < width; i++)
+        value |= (uint64_t)p[i] << (8 * i);
+    return value;
+}
+
+memory_image_spec parse_memory_image_spec(const string &spec)
+{
+    memory_image_spec image;
+    string rest = spec;
+
+    size_t colon = rest.rfind(':');
+    if (colon != string::npos && colon > rest.rfind('/') + 1)
+    {
+        image.width = stoul(rest.substr(colon + 1));
+        rest = rest.substr(0, colon);
+    }
+    size_t at = rest.rfind('@');
+    if (at != string::npos)
+    {
+        image.base = stoull(rest.substr(at + 1), nullptr, 0);
+        rest = rest.substr(0, at);
+    }
+    image.path = rest;
+
+    if (image.width != 1 && image.width != 2 && image.width != 4 && image.width != 8)
+        throw invalid_argument("memory image width must be 1, 2, 4 or 8: " + spec);
+    if (image.path.empty())
+        throw invalid_argument("memory image needs a file: " + spec);
+    return image;
+}
+
+size_t load_memory_image(map<uint64_t, int64_t> &memory, const memory_image_spec &spec)
+{
+    size_t words = 0;
+
+    if (is_binary_image(spec.path))
+    {
+        mapped_file file(spec.path);
+        if (file.size() % spec.width != 0)
+            throw runtime_error(spec.path + " is not a whole number of " + to_string(spec.width) + "-byte words");
+
+        // Addresses ascend, so each insert lands at the end of the map
+        auto hint = memory.lower_bound(spec.base);
+        for (size_t offset = 0; offset < file.size(); offset += spec.width, words++)
+        {
+            uint64_t address = spec.base + offset;
+            hint = memory.insert_or_assign(hint, address, sign_extend(read_le(file.data() + offset, spec.width), spec.width));
+            ++hint;
+        }
+        return words;
+    }
+
+    ifstream input(spec.path);
+    if (!input.is_open())
+        throw runtime_error("Could not open file " + spec.path);
+
+    uint64_t address = spec.base;
+    string line;
+    while (getline(input, line))
+    {
+        size_t comment = min(line.find("//"), line.find('#'));
+        if (comment != string::npos)
+            line.erase(comment);
+
+        istringstream tokens(line);
+        string token;
+        while (tokens >> token)
+        {
+            if (token[0] == '@')
+            {
+                address = stoull(token.substr(1), nullptr, 16);
+                continue;
+            }
+            memory[address] = sign_extend(stoull(token, nullptr, 16), spec.width);
+            address += spec.width;
+            words++;
+        }
+    }
+    return words;
+}
+
+void load_register_image(int64_t *registers, const string &path)
+{
+    if (is_binary_image(path))
+    {
+        mapped_file file(path);
+        size_t count = min<size_t>(file.size() / 8, 32);
+        for (size_t i = 1; i < count; i++)
+            registers[i] = (int64_t)read_le(file.data() + i * 8, 8);
+        return;
+    }
+
+    ifstream input(path);
+    if (!input.is_open())
+        throw runtime_error("Could not open file " + path);
+
+    string line;
+    int line_number = 0;
+    while (getline(input, line))
+    {
+        line_number++;
+        size_t comment = line.find('#');
+        if (comment != string::npos)
+            line.erase(comment);
+
+        istringstream tokens(line);
+        string name, value;
+        if (!(tokens >> name))
+            continue;
+        if (name.size() < 2 || name[0] != 'x' || !(tokens >> value))
+            throw runtime_error(path + ":" + to_string(line_number) + ": expected \"xN value\"");
+
+        int index = stoi(name.substr(1));
+        if (index < 0 || index > 31)
+            throw runtime_error(path + ":" + to_string(line_number) + ": no register " + name);
+        if (index != 0)
+            registers[index] = (int64_t)stoull(value, nullptr, 0);
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef STATE_IMAGE_HPP
+#define STATE_IMAGE_HPP
+
+#include "ds.hpp"
+#include <string>
+
+// Initial architectural state read from files, so a kernel can start from
+// prepared inputs instead of spending cycles building them with instructions.
+//
+// Memory images ("path[@base][:width]", base defaults to 0, width to 4 bytes):
+//   *.bin  raw little-endian words, mapped with mmap; word i is stored at
+//          base + i * width, sign-extended from width bytes
+//   other  hex text in $readmemh style: "@addr" (hex byte address) moves the
+//          load address, every other token is one hex word; "//" and "#"
+//          start comments
+//
+// Register files:
+//   *.bin  up to 32 little-endian 64-bit values for x0..x31
+//   other  one "xN value" pair per line, value in decimal or 0x hex
+// x0 is never written.
+
+struct memory_image_spec
+{
+    string path;
+    uint64_t base = 0;
+    unsigned width = 4;
+};
+
+memory_image_spec parse_memory_image_spec(const string &spec);
+
+// Returns the number of words stored
+size_t load_memory_image(map<uint64_t, int64_t> &memory, const memory_image_spec &spec);
+
+// Registers not mentioned in a text file keep their current value
+void load_register_image(int64_t *registers, const string &path);
+
+#endif // STATE_IMAGE_HPP
@@ -0,0 +1,84 @@
+#include "stats.hpp"
+#include <stdexcept>
+
+// Rows queued before the writer thread is woken
+static const size_t wake_batch = 64;
+
+stats_writer::stats_writer(const string &path, uint64_t interval, interval_unit unit)
+    : out(path), interval(interval ? interval : 1), unit(unit), next_due(this->interval)
+{
+    if (!out.is_open())
+        throw runtime_error("Could not open file " + path);
+    out << "cycle,instructions,cpi,stall_fraction,flushes,wrong_path,memory_words,roi,steady\n";
+    worker = thread(&stats_writer::drain, this);
+}
+
+void stats_writer::append(const stats_snapshot &s)
+{
+    uint64_t at = unit == Cycles ? s.cycles : s.instructions;
+    next_due = (at / interval + 1) * interval;
+    last_cycle = s.cycles;
+    queued++;
+
+    size_t waiting;
+    {
+        lock_guard<mutex> guard(lock);
+        pending.push_back(s);
+        waiting = pending.size();
+    }
+    if (waiting >= wake_batch)
+        wake.notify_one();
+}
+
+void stats_writer::close(const stats_snapshot *last)
+{
+    if (!worker.joinable())
+        return;
+    {
+        lock_guard<mutex> guard(lock);
+        if (last && last->cycles > last_cycle)
+        {
+            pending.push_back(*last);
+            queued++;
+        }
+        closing = true;
+    }
+    wake.notify_one();
+    worker.join();
+    out.close();
+}
+
+void stats_writer::drain()
+{
+    vector<stats_snapshot> batch;
+    unique_lock<mutex> guard(lock);
+    while (true)
+    {
+        wake.wait(guard, [this]() { return closing || pending.size() >= wake_batch; });
+        batch.swap(pending);
+        bool done = closing;
+        guard.unlock();
+
+        for (const stats_snapshot &s : batch)
+            emit(s);
+        batch.clear();
+        if (done)
+            break;
+        guard.lock();
+    }
+    out.flush();
+}
+
+void stats_writer::emit(const stats_snapshot &s)
+{
+    uint64_t cycles = s.cycles - previous.cycles;
+    uint64_t instructions = s.instructions - previous.instructions;
+    double cpi = instructions ? (double)cycles / instructions : 0.0;
+    double stalls = cycles ? (double)(s.stall_cycles - previous.stall_cycles) / cycles : 0.0;
+    bool steady = instructions && previous_cpi > 0 && cpi > previous_cpi * 0.99 && cpi < previous_cpi * 1.01;
+
+    out << s.cycles << ',' << s.instructions << ',' << cpi << ',' << stalls << ','
+        << s.flushes - previous.flushes << ',' << s.wrong_path - previous.wrong_path << ',' << s.memory_cells << ',' << s.in_roi << ',' << steady << '\n';
+    previous = s;
+    previous_cpi = cpi;
+}
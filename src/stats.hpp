@@ -0,0 +1,83 @@
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Counter values at one sampling point; the writer turns consecutive ones into
+// per-interval rates
+struct stats_snapshot
+{
+    uint64_t cycles;
+    uint64_t instructions;
+    uint64_t stall_cycles;
+    uint64_t flushes;
+    uint64_t wrong_path;
+    uint64_t memory_cells; // data memory words touched so far
+    bool in_roi;
+};
+
+// Time series of statistics snapshots, one CSV row every interval cycles (or
+// retired instructions), for watching the phases of a long run without a
+// diagram. The simulation thread only queues snapshots; formatting and file
+// output happen on a background thread.
+//
+// Columns: cycle, instructions, interval CPI, stall fraction, flushes and
+// wrong-path instructions in the interval, memory footprint in words, whether
+// a region of interest is open, and steady, set when the interval CPI is
+// within 1% of the previous one.
+class stats_writer
+{
+public:
+    enum interval_unit
+    {
+        Cycles,
+        Instructions
+    };
+
+private:
+    ofstream out;
+    uint64_t interval;
+    interval_unit unit;
+    uint64_t next_due;
+    uint64_t queued = 0;
+    uint64_t last_cycle = 0;
+
+    // Filled by the simulation thread, swapped out and drained by the writer thread
+    vector<stats_snapshot> pending;
+    mutex lock;
+    condition_variable wake;
+    bool closing = false;
+    thread worker;
+
+    // Writer-thread state
+    stats_snapshot previous = {};
+    double previous_cpi = 0;
+
+    void drain();
+    void emit(const stats_snapshot &s);
+
+public:
+    stats_writer(const string &path, uint64_t interval, interval_unit unit = Cycles);
+    ~stats_writer() { close(); }
+    stats_writer(const stats_writer &) = delete;
+    stats_writer &operator=(const stats_writer &) = delete;
+
+    bool due(uint64_t cycles, uint64_t instructions) const
+    {
+        return (unit == Cycles ? cycles : instructions) >= next_due;
+    }
+    void append(const stats_snapshot &s);
+    // Writes a final row for a partial interval if there is one, then stops the writer
+    void close(const stats_snapshot *last = nullptr);
+    uint64_t snapshots() const { return queued; }
+};
+
+#endif // STATS_HPP
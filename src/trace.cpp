@@ -0,0 +1,104 @@
+#include "trace.hpp"
+#include <cstring>
+#include <fcntl.h>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char trace_magic[8] = {'P', 'S', 'T', 'R', 'A', 'C', 'E', '1'};
+
+// Replayed pages are dropped in chunks of this size once the cursor is past them
+static const size_t release_chunk = 64u << 20;
+
+instruction_trace::instruction_trace(const string &path)
+{
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw runtime_error("Could not open file " + path);
+    struct stat info;
+    if (fstat(fd, &info) != 0)
+    {
+        close(fd);
+        throw runtime_error("Could not stat " + path);
+    }
+    length = info.st_size;
+    if (length < sizeof(trace_magic) || (length - sizeof(trace_magic)) % sizeof(trace_record) != 0)
+    {
+        close(fd);
+        throw runtime_error(path + " is not a trace file");
+    }
+
+    void *view = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (view == MAP_FAILED)
+        throw runtime_error("Could not map " + path);
+    base = static_cast<uint8_t *>(view);
+
+    if (memcmp(base, trace_magic, sizeof(trace_magic)) != 0)
+    {
+        munmap(base, length);
+        throw runtime_error(path + " is not a trace file");
+    }
+    madvise(base, length, MADV_SEQUENTIAL);
+
+    records = reinterpret_cast<const trace_record *>(base + sizeof(trace_magic));
+    count = (length - sizeof(trace_magic)) / sizeof(trace_record);
+}
+
+instruction_trace::~instruction_trace()
+{
+    if (base)
+        munmap(base, length);
+}
+
+void instruction_trace::release_before(uint64_t index)
+{
+    size_t offset = sizeof(trace_magic) + index * sizeof(trace_record);
+    if (offset < released + release_chunk)
+        return;
+    // The mapping is page aligned, so rounding down keeps madvise's address aligned
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t end = offset / page * page;
+    madvise(base + released, end - released, MADV_DONTNEED);
+    released = end;
+}
+
+trace_writer::trace_writer(const string &path) : out(path, ios::binary)
+{
+    if (!out.is_open())
+        throw runtime_error("Could not open file " + path);
+    out.write(trace_magic, sizeof(trace_magic));
+}
+
+void trace_writer::emit(const trace_record &record)
+{
+    out.write(reinterpret_cast<const char *>(&record), sizeof(record));
+    written++;
+}
+
+void trace_writer::append(uint64_t pc, uint32_t instruction, uint64_t address)
+{
+    if (!out.is_open())
+        return;
+    if (has_pending)
+    {
+        uint32_t opcode = pending.instruction & 0x7F;
+        bool control = opcode == 0x63 || opcode == 0x6F || opcode == 0x67;
+        if (control && pc != pending.pc + 4)
+            pending.flags |= TRACE_TAKEN;
+        emit(pending);
+    }
+    pending = {pc, address, instruction, 0};
+    has_pending = true;
+}
+
+void trace_writer::close()
+{
+    if (!out.is_open())
+        return;
+    if (has_pending)
+        emit(pending);
+    has_pending = false;
+    out.close();
+}
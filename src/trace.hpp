@@ -0,0 +1,86 @@
+#ifndef TRACE_HPP
+#define TRACE_HPP
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+
+using namespace std;
+
+// Dynamic instruction traces for trace-driven timing runs.
+//
+// File layout: the 8-byte magic "PSTRACE1", then one 24-byte little-endian
+// record per committed instruction, in program order. The record count is
+// implied by the file size, so a trace can be written as a plain stream.
+//
+//   offset 0   uint64  pc
+//   offset 8   uint64  effective address (loads and stores; ignored otherwise)
+//   offset 16  uint32  instruction word
+//   offset 20  uint32  flags, bit 0 = control transfer taken
+//
+// A record is "taken" when the next record does not start at pc + 4.
+
+enum trace_flags : uint32_t
+{
+    TRACE_TAKEN = 1
+};
+
+struct trace_record
+{
+    uint64_t pc;
+    uint64_t address;
+    uint32_t instruction;
+    uint32_t flags;
+
+    bool taken() const { return flags & TRACE_TAKEN; }
+};
+static_assert(sizeof(trace_record) == 24, "trace records are read straight from the file");
+
+// Read-only, memory-mapped trace. Pages are read ahead sequentially and
+// released again behind the replay cursor, so resident memory stays flat
+// however long the trace is.
+class instruction_trace
+{
+    uint8_t *base = nullptr;
+    size_t length = 0;
+    const trace_record *records = nullptr;
+    uint64_t count = 0;
+    size_t released = 0; // bytes already handed back to the kernel
+
+public:
+    explicit instruction_trace(const string &path);
+    ~instruction_trace();
+    instruction_trace(const instruction_trace &) = delete;
+    instruction_trace &operator=(const instruction_trace &) = delete;
+
+    uint64_t size() const { return count; }
+    const trace_record &operator[](uint64_t index) const { return records[index]; }
+
+    // The replay never looks at records before index again
+    void release_before(uint64_t index);
+};
+
+// Streams records out in commit order. A record is held back until the next
+// one arrives, because only then is it known whether its branch was taken.
+class trace_writer
+{
+    ofstream out;
+    trace_record pending = {};
+    bool has_pending = false;
+    uint64_t written = 0;
+
+    void emit(const trace_record &record);
+
+public:
+    explicit trace_writer(const string &path);
+    ~trace_writer() { close(); }
+    trace_writer(const trace_writer &) = delete;
+    trace_writer &operator=(const trace_writer &) = delete;
+
+    void append(uint64_t pc, uint32_t instruction, uint64_t address);
+    // Writes the last record and flushes; later appends are dropped
+    void close();
+    uint64_t records() const { return written + has_pending; }
+};
+
+#endif // TRACE_HPP